@@ -1,38 +1,102 @@
 #include "BURT_TMC.h"
 
 const int blockDelay = 10;  // ms
+const unsigned long homingTimeout = 30000;  // ms
+const int stallGuardMargin = 100;  // free running SG_RESULT must stay above this
+const int stallGuardSamples = 16;
+const unsigned long encoderCheckInterval = 20;  // ms
+const unsigned long jogInterval = 20;  // ms between VMAX writes while jogging
+const unsigned long jogSettleTime = 200;  // ms before a small stick change is sent
+const unsigned long velocityStopTimeout = 5000;  // ms to wait for vzero before leaving velocity mode anyway
+const uint32_t jogResolution = 50;  // changes under 1/50 of jog speed are small
+const int32_t thermalTimeConstant = 60000;  // ms, of a typical motor winding
+
+// The pin and config structs stay aggregates, so older sketches can still brace
+// initialize them under C++11. Unset fields are 0 and get their defaults here,
+// except where 0 is a setting of its own.
+static StepperMotorPins with_defaults(StepperMotorPins pins) {
+  if (pins.diag == 0) pins.diag = -1;
+  return pins;
+}
+
+static StepperMotorConfig with_defaults(StepperMotorConfig config) {
+  if (config.maxDeviation == 0) config.maxDeviation = 1024;
+  if (config.clockFrequency == 0) config.clockFrequency = driverClock;
+  if (config.rsense == 0) config.rsense = 0.075;
+  if (config.spi == nullptr) config.spi = &SPI;
+  return config;
+}
 
 StepperMotor::StepperMotor(StepperMotorPins pins, StepperMotorConfig config) : 
-  pins(pins),
-  config(config),
-  driver(TMC5160Stepper(SPI, pins.chipSelect, 0.075))
-  { }
+  pins(with_defaults(pins)),
+  config(with_defaults(config)),
+  clock(this->config.clockFrequency),
+  driver(TMC5160Stepper(*this->config.spi, pins.chipSelect, this->config.rsense))
+  { update_limits(); }
 
 StepperMotor::StepperMotor(StepperMotorPins pins, StepperMotorConfig config, LimitSwitch limitSwitch) :
-  pins(pins),
-  config(config),
-  driver(TMC5160Stepper(SPI, pins.chipSelect, 0.075)),
+  pins(with_defaults(pins)),
+  config(with_defaults(config)),
+  clock(this->config.clockFrequency),
+  driver(TMC5160Stepper(*this->config.spi, pins.chipSelect, this->config.rsense)),
   limitSwitch(limitSwitch)
-  { }
+  { update_limits(); }
 
 bool StepperMotor::isMoving() {
-  return driver.XTARGET() != driver.XACTUAL();
+  return leavingVelocityMode || !driver.position_reached();
+}
+
+int StepperMotor::currentSteps(bool forceRead) {
+  return motionState(forceRead).xactual + limitSwitch.offset + homeSteps;
 }
 
-int StepperMotor::currentSteps() {
-  return driver.XACTUAL() + limitSwitch.offset + limitSwitch.position * config.stepsPerUnit;
+int StepperMotor::targetSteps(bool forceRead) {
+  return motionState(forceRead).xtarget + limitSwitch.offset + homeSteps;
 }
 
-int StepperMotor::targetSteps() {
-  return driver.XTARGET() + limitSwitch.offset + limitSwitch.position * config.stepsPerUnit;
+double StepperMotor::currentPosition(bool forceRead) {
+  return currentSteps(forceRead) / config.stepsPerUnit;
 }
 
-double StepperMotor::currentPosition() {
-  return currentSteps() / config.stepsPerUnit;
+double StepperMotor::targetPosition(bool forceRead) {
+  return targetSteps(forceRead) / config.stepsPerUnit;
 }
 
-double StepperMotor::targetPosition() {
-  return targetSteps() / config.stepsPerUnit;
+// In units per second, from VACTUAL
+double StepperMotor::currentVelocity(bool forceRead) {
+  return clock.toVelocity(motionState(forceRead).vactual).microstepsPerSecond / config.stepsPerUnit;
+}
+
+// Reads the motion state in one batch and applies the current policy. Call
+// it regularly, Arm::poll() does it for every joint. A motor that's never
+// refreshed reports stale positions and never changes its current level.
+void StepperMotor::refresh() {
+  if (!isOnline()) return;
+  static const uint8_t addresses[] = {
+    TMC5160Stepper::XACTUAL_t::address,
+    TMC5160Stepper::XTARGET_t::address,
+    TMC5160Stepper::VACTUAL_t::address,
+    TMC5160Stepper::RAMP_STAT_t::address,
+    TMC5160Stepper::DRV_STATUS_t::address,
+  };
+  uint32_t values[5];
+  driver.readBatch(addresses, values, 5);
+  if (check_reset()) return;  // the values read are from a blank driver
+
+  state.xactual = values[0];
+  state.xtarget = values[1];
+  state.vactual = values[2] & 0x800000 ? values[2] | 0xFF000000 : values[2];  // 24 bit signed
+  state.rampStat = values[3];
+  state.drvStatus = values[4];
+  state.timestamp = millis();
+  update_current();
+}
+
+// Returns the values from the last refresh(), reading the driver only when
+// asked to or when nothing has been read yet.
+const MotionState& StepperMotor::motionState(bool forceRead) {
+  if (forceRead || state.timestamp == 0) refresh();
+  return state;
 }
 
 void StepperMotor::presetup() {
@@ -40,88 +104,640 @@ void StepperMotor::presetup() {
   digitalWrite(pins.chipSelect, HIGH);
 }
 
-void StepperMotor::reset_driver() {
+// Resetting is split around the resetDelay wait so Arm can share one wait
+// between all of its joints.
+void StepperMotor::start_reset() {
+  pinMode(pins.enable, OUTPUT);
+  digitalWrite(pins.enable, LOW);
+  if (limitSwitch.pin != -1) pinMode(limitSwitch.pin, INPUT_PULLUP);
+  limitSwitch.attach(on_limit, this);
   driver.begin();
   driver.reset();
+  state = MotionState();  // the driver starts over from 0
   digitalWrite(pins.enable, HIGH);  // disable driver to clear the cache
-	delay(1000);
+}
+
+void StepperMotor::end_reset() {
 	digitalWrite(pins.enable, LOW);   // re-enable drive, to start loading in parameters
 }
 
-void StepperMotor::check_driver() {
+// Doesn't stop the program, so the other motors can keep working. A motor
+// that fails here ignores moves until it passes.
+DriverStatus StepperMotor::check_driver() {
   TMC5160Stepper::IOIN_t ioin { driver.IOIN() };
-  if (ioin.version == 0xFF || ioin.version == 0) {
-    Serial.print("\nDriver communication error on motor: ");
-    Serial.println(config.name);
-    while (true);
-  } else if (ioin.sd_mode) {
-    Serial.println("Motor is configured for Step & Direction mode: ");
-    Serial.println(config.name);
-    while (true);
-  } else if (ioin.drv_enn) {
-    Serial.println("Motor is not hardware enabled: ");
-    Serial.println(config.name);
-    while (true);
+  if (ioin.version == 0xFF || ioin.version == 0) driverStatus = DriverStatus::noResponse;
+  else if (ioin.sd_mode) driverStatus = DriverStatus::stepDirMode;
+  else if (ioin.drv_enn) driverStatus = DriverStatus::notEnabled;
+  else driverStatus = DriverStatus::ok;
+
+  if (driverStatus != DriverStatus::ok) {
+    Serial.print("\nMotor ");
+    Serial.print(config.name);
+    Serial.print(" failed: ");
+    Serial.println(describeStatus(driverStatus));
+  }
+  return driverStatus;
+}
+
+const char* describeStatus(DriverStatus status) {
+  switch (status) {
+    case DriverStatus::unknown: return "not set up";
+    case DriverStatus::ok: return "ok";
+    case DriverStatus::noResponse: return "driver communication error";
+    case DriverStatus::stepDirMode: return "configured for Step & Direction mode";
+    case DriverStatus::notEnabled: return "not hardware enabled";
   }
+  return "";
+}
+
+DriverStatus StepperMotor::status() {
+  return driverStatus;
+}
+
+bool StepperMotor::isOnline() {
+  return driverStatus == DriverStatus::ok;
 }
 
 void StepperMotor::write_settings() {
   // TODO: Decide if everything below this is needed: 
 	// See https://github.com/BinghamtonRover/arm-firmware/issues/6
   driver.GSTAT(7);
-	driver.rms_current(config.current);
+	setup_current();
 	driver.tbl(2);
 	driver.toff(9);
 	driver.pwm_freq(1);
-	driver.a1(config.acceleration);
-	driver.v1(config.speed);
-	driver.AMAX(config.acceleration);
-	driver.VMAX(config.speed);
-	driver.DMAX(config.acceleration);
-	driver.d1(config.acceleration);
-	driver.vstop(100);
-	driver.vstart(100);
+	write_ramp(defaultRamp(), true);
 	driver.RAMPMODE(0);
 }
 
-void StepperMotor::setup() {
+// GLOBAL_SCALER is set for the highest current the motor will use, so the
+// other levels only need a smaller IRUN or IHOLD. Every level is packed into
+// its IHOLD_IRUN word here, and switching is then a single write.
+void StepperMotor::setup_current() {
+  int peak = config.boostCurrent > config.current ? config.boostCurrent : config.current;
+  driver.rms_current(peak);
+  TMC5160Stepper::IHOLD_IRUN_t base { driver.IHOLD_IRUN() };  // write only, so this is the cache
+  uint8_t peakScale = base.irun;
+
+  uint8_t run = current_scale(config.current, peak, peakScale);
+  uint8_t hold = config.holdCurrent > 0 ? current_scale(config.holdCurrent, peak, peakScale) : run / 2;
+  uint8_t idle = config.idleCurrent > 0 ? current_scale(config.idleCurrent, peak, peakScale) : hold;
+
+  TMC5160Stepper::IHOLD_IRUN_t word { base.sr };
+  word.ihold = hold;
+  word.irun = peakScale;
+  boostCurrentWord = word.sr;
+  word.irun = run;
+  runCurrentWord = word.sr;
+  word.ihold = idle;
+  idleCurrentWord = word.sr;
+
+  driver.IHOLD_IRUN(runCurrentWord);
+  currentWord = runCurrentWord;
+}
+
+// The current is proportional to CS + 1 at a fixed GLOBAL_SCALER
+uint8_t StepperMotor::current_scale(int current, int peak, uint8_t peakScale) {
+  int32_t scale = ((int32_t) (peakScale + 1) * current + peak / 2) / peak - 1;
+  if (scale < 0) return 0;
+  if (scale > 31) return 31;
+  return scale;
+}
+
+// Runs after every refresh() from the values it read, so it costs no extra
+// reads: boost while speeding up, the normal current while cruising or
+// slowing down, and the idle hold current after idleTime at standstill.
+// The driver itself drops to IHOLD once it stops.
+void StepperMotor::update_current() {
+  TMC5160Stepper::RAMP_STAT_t ramp { state.rampStat };
+  uint32_t speed = state.vactual < 0 ? -state.vactual : state.vactual;
+  bool standstill = ramp.vzero;
+  bool accelerating = !standstill && !ramp.velocity_reached && speed > lastSpeed;
+  lastSpeed = speed;
+  if (!standstill) lastMotion = state.timestamp;
+
+  uint32_t word = accelerating ? boostCurrentWord : runCurrentWord;
+  if (standstill && state.timestamp - lastMotion >= config.idleTime) word = idleCurrentWord;
+  update_heat(word, standstill);
+  if (word == currentWord) return;
+  driver.IHOLD_IRUN(word);
+  currentWord = word;
+}
+
+// A first order model of the winding temperature: heat follows the square
+// of the current, with thermalTimeConstant as its time constant.
+void StepperMotor::update_heat(uint32_t word, bool standstill) {
+  unsigned long elapsed = state.timestamp - lastHeatUpdate;
+  lastHeatUpdate = state.timestamp;
+  if (elapsed > (unsigned long) thermalTimeConstant) elapsed = thermalTimeConstant;
+
+  TMC5160Stepper::IHOLD_IRUN_t levels { word };
+  int32_t scale = (standstill ? levels.ihold : levels.irun) + 1;
+  int32_t target = scale * scale << 16;
+  heat += (int64_t) (target - heat) * (int32_t) elapsed / thermalTimeConstant;
+}
+
+// The heat estimate in percent of running at `current` nonstop. Boosting
+// can take it above 100.
+int StepperMotor::thermalLoad() {
+  TMC5160Stepper::IHOLD_IRUN_t run { runCurrentWord };
+  int32_t scale = run.irun + 1;
+  return (int64_t) heat * 100 / (scale * scale << 16);
+}
+
+RampParameters StepperMotor::defaultRamp() {
+  if (plannedRamp.vmax != 0) return plannedRamp;
+  RampParameters ramp;
+  ramp.vstart = 100;
+  ramp.a1 = config.acceleration;
+  ramp.v1 = config.speed;
+  ramp.amax = config.acceleration;
+  ramp.vmax = config.speed;
+  ramp.dmax = config.acceleration;
+  ramp.d1 = config.acceleration;
+  ramp.vstop = 100;
+  return ramp;
+}
+
+// Replaces speed and acceleration from the config with a full six point
+// ramp planned from the joint's physical limits. Takes effect on the next move.
+void StepperMotor::setLimits(const MotionLimits& limits) {
+  plannedRamp = planRamp(limits, clock);
+}
+
+// Seconds a move of this many steps takes from standstill on the default ramp
+double StepperMotor::predictMoveTime(int steps) {
+  return moveTime(defaultRamp(), steps, clock);
+}
+
+const RampParameters& StepperMotor::ramp() {
+  return rampParameters;
+}
+
+void StepperMotor::setRamp(const RampParameters& ramp) {
+  stopJog();  // every move sets its ramp first
+  if (leavingVelocityMode) rampAfterStop = ramp;  // VMAX stays 0 until the motor has stopped
+  else write_ramp(ramp, false);
+}
+
+// Only writes the registers that changed since the last call
+void StepperMotor::write_ramp(const RampParameters& ramp, bool force) {
+  RampParameters& current = rampParameters;
+  if (force || ramp.a1 != current.a1) driver.a1(ramp.a1);
+  if (force || ramp.v1 != current.v1) driver.v1(ramp.v1);
+  if (force || ramp.amax != current.amax) driver.AMAX(ramp.amax);
+  if (force || ramp.vmax != current.vmax) driver.VMAX(ramp.vmax);
+  if (force || ramp.dmax != current.dmax) driver.DMAX(ramp.dmax);
+  if (force || ramp.d1 != current.d1) driver.d1(ramp.d1);
+  if (force || ramp.vstop != current.vstop) driver.vstop(ramp.vstop);
+  if (force || ramp.vstart != current.vstart) driver.vstart(ramp.vstart);
+  current = ramp;
+}
+
+// Returns false if the driver failed its check, see status()
+bool StepperMotor::setup() {
+  start_reset();
+  delay(resetDelay);
+  end_reset();
+  if (check_driver() != DriverStatus::ok) return false;
+  configure();
+  return true;
+}
+
+void StepperMotor::configure() {
+  update_limits();
   Serial.print("Initializing motor ");
   Serial.print(config.name);
   Serial.print("... ");
-  pinMode(pins.enable, OUTPUT);
-  digitalWrite(pins.enable, LOW);
-  if (limitSwitch.pin != -1) pinMode(limitSwitch.pin, INPUT_PULLUP);
-  reset_driver();
-  check_driver();
   write_settings();
+  if (limitSwitch.isHardware) setup_limit();
+  if (hasEncoder()) setup_encoder();
+  if (pins.diag != -1) setup_diag();
   Serial.println("Done!");
 }
 
-void StepperMotor::calibrate() {
-  // if (!limitSwitch.isAttached()) return;
-  // while (!limitSwitch.isPressed()) {
-  //   moveBySteps(10 * limitSwitch.direction);
-  // }
+void StepperMotor::setup_diag() {
+  // With SD_MODE=0, DIAG0 is the interrupt output for the RAMP_STAT events.
+  // Push-pull makes it active high, so no pull-up is needed.
+  pinMode(pins.diag, INPUT);
+  driver.diag0_int_pushpull(true);
+  driver.RAMP_STAT(driver.RAMP_STAT());  // clear stale events
+  diagEvent = false;
+  // Polls the driver instead if the pin has no interrupt
+  if (!attachContextInterrupt(pins.diag, on_diag, this, RISING)) pins.diag = -1;
+}
+
+void StepperMotor::setup_limit() {
+  // The driver stops by itself when the switch goes active, and latches
+  // XACTUAL into XLATCH on the same edge.
+  TMC5160Stepper::SW_MODE_t mode { 0 };
+  bool activeLow = limitSwitch.triggeredValue == LOW;
+  if (limitSwitch.direction > 0) {
+    mode.stop_r_enable = true;
+    mode.pol_stop_r = activeLow;
+    mode.latch_r_active = true;
+  } else {
+    mode.stop_l_enable = true;
+    mode.pol_stop_l = activeLow;
+    mode.latch_l_active = true;
+  }
+  mode.en_softstop = limitSwitch.softStop;
+  driver.SW_MODE(mode.sr);
+}
+
+// ENC_CONST is microsteps per encoder count in 16.16 fixed point. The 5160
+// compares X_ENC to XACTUAL on its own and sets ENC_STATUS.deviation_warn
+// when they drift more than ENC_DEVIATION apart.
+void StepperMotor::setup_encoder() {
+  int32_t factor = config.stepsPerUnit / config.encoderCountsPerUnit * 65536;
+  driver.ENCMODE(0);  // binary prescaler, no index channel
+  driver.ENC_CONST(factor);
+  driver.XENC(driver.XACTUAL());
+  driver.ENC_DEVIATION(config.maxDeviation);
+  driver.ENC_STATUS(3);  // clear stale flags
+}
+
+bool StepperMotor::hasEncoder() {
+  return config.encoderCountsPerUnit != 0;
+}
+
+// Trusts the encoder: moves XACTUAL to X_ENC and sends the target again, so
+// the ramp makes up the lost steps.
+void StepperMotor::check_encoder() {
+  if (millis() - lastEncoderCheck < encoderCheckInterval) return;
+  lastEncoderCheck = millis();
+  TMC5160Stepper::ENC_STATUS_t status { driver.ENC_STATUS() };
+  if (!status.deviation_warn) return;
+
+  DeviationEvent event;
+  event.xactual = driver.XACTUAL();
+  event.xenc = driver.XENC();
+  event.timestamp = lastEncoderCheck;
+  driver.XACTUAL(event.xenc);
+  driver.ENC_STATUS(status.sr);
+  // Written directly: write_target() would skip the unchanged target and
+  // mark an idle motor as moving
+  if (!jogging) driver.XTARGET(state.xtarget);
+
+  if (deviations.isFull()) {
+    DeviationEvent oldest;
+    deviations.pop(oldest);
+  }
+  deviations.push(event);
+  totalDeviations++;
+  if (deviationCallback != nullptr) deviationCallback(*this);
+}
+
+unsigned long StepperMotor::deviationCount() {
+  return totalDeviations;
+}
+
+// Pops the oldest logged deviation. The log keeps the latest few.
+bool StepperMotor::nextDeviation(DeviationEvent& event) {
+  return deviations.pop(event);
+}
+
+void StepperMotor::onDeviation(MotorCallback callback) {
+  deviationCallback = callback;
+}
+
+// Every reply starts with a status byte, and its reset flag stays set until
+// GSTAT is cleared, so this costs no extra reads.
+bool StepperMotor::check_reset() {
+  TMC5160Stepper::SPI_STATUS_t status { driver.spi_status() };
+  if (!status.reset_flag) return false;
+  recover_from_reset();
+  return true;
+}
+
+// A brown-out leaves the driver with default registers and XACTUAL at 0.
+// Everything it lost is cached here, so write it back. The encoder counter
+// is on the chip and was reset too, so the position comes from the cache:
+// a finished move ended on its target, otherwise the last refresh is the
+// best guess.
+void StepperMotor::recover_from_reset() {
+  int32_t position = moving && state.timestamp != 0 ? state.xactual : state.xtarget;
+  int32_t target = state.xtarget;
+  RampParameters ramp = rampParameters;
+  if (jogging || leavingVelocityMode) {
+    // The driver is back in positioning mode, so the jog is over
+    jogging = false;
+    leavingVelocityMode = false;
+    position = state.xactual;
+    target = position;
+    ramp = defaultRamp();
+  }
+
+  // VMAX is 0 after a reset, so nothing moves until the ramp is written
+  driver.XACTUAL(position);
+  driver.XTARGET(position);
+  write_settings();  // also clears GSTAT, and with it the reset flag
+  write_ramp(ramp, true);
+  if (limitSwitch.isHardware) setup_limit();
+  if (hasEncoder()) setup_encoder();
+  if (pins.diag != -1) {
+    driver.diag0_int_pushpull(true);
+    driver.RAMP_STAT(driver.RAMP_STAT());
+  }
+  if (moving) driver.XTARGET(target);
+  state.xactual = position;
+  state.xtarget = moving ? target : position;
+
+  totalResets++;
+  if (resetCallback != nullptr) resetCallback(*this);
+}
+
+void StepperMotor::onReset(MotorCallback callback) {
+  resetCallback = callback;
+}
+
+unsigned long StepperMotor::resetCount() {
+  return totalResets;
+}
+
+void StepperMotor::on_diag(void* context) {
+  static_cast<StepperMotor*>(context)->diagEvent = true;
+}
+
+void StepperMotor::on_limit(void* context) {
+  static_cast<StepperMotor*>(context)->limitEvent = true;
+}
+
+void StepperMotor::handle_events() {
+  diagEvent = false;
+  TMC5160Stepper::RAMP_STAT_t status { driver.RAMP_STAT() };
+  if (status.sr & 0xFC) driver.RAMP_STAT(status.sr);  // latch and event flags are cleared by writing them back
+  if ((status.event_stop_l || status.event_stop_r) && moving) {
+    // A soft stop is still ramping down, so look again on the next update
+    if (limitSwitch.softStop && !status.vzero) diagEvent = true;
+    else stop_at_limit();
+  }
+  if (status.event_stop_sg && stallCallback != nullptr) stallCallback(*this);
+  if (status.event_pos_reached || status.position_reached) finish_move();
+}
+
+// The driver has already stopped at the switch, but XTARGET is still past it.
+// Sync it to XACTUAL, or the motor carries on once the switch releases.
+void StepperMotor::stop_at_limit() {
+  latch = driver.XLATCH();
   stop();
-  int limitSteps = limitSwitch.position * config.stepsPerUnit;
-  // limitSwitch.offset = limitSteps - driver.XACTUAL() * limitSwitch.direction;
-  limitSwitch.offset = -driver.XACTUAL();
+  finish_move();
+}
+
+void StepperMotor::finish_move() {
+  if (!moving) return;
+  moving = false;
+  if (moveCompleteCallback != nullptr) moveCompleteCallback(*this);
+}
+
+void StepperMotor::wait_for_diag(unsigned long timeout) {
+  unsigned long start = millis();
+  while (!diagEvent && millis() - start < timeout);
+}
+
+void StepperMotor::onMoveComplete(MotorCallback callback) {
+  moveCompleteCallback = callback;
+}
+
+void StepperMotor::onStall(MotorCallback callback) {
+  stallCallback = callback;
+}
+
+// Drives toward the limit switch in velocity mode and zeroes the position
+// where the switch was hit, in a single pass. Returns false if the switch
+// wasn't reached within homingTimeout.
+bool StepperMotor::calibrate() {
+  if (!isOnline()) return false;
+  stopJog();
+  while (leavingVelocityMode) check_velocity_stop();
+  update_limits();
+  if (!limitSwitch.isAttached()) {
+    stop();
+    limitSwitch.offset = -driver.XACTUAL();
+    return true;
+  }
+
+  RampParameters ramp = defaultRamp();
+  ramp.vmax = homing_speed();
+  setRamp(ramp);
+  if (limitSwitch.isSensorless) {
+    setup_stallguard(ramp.vmax, limitSwitch.stallThreshold);
+    stop_on_stall(true);
+  }
+  driver.RAMP_STAT(driver.RAMP_STAT());  // clear stale latches and events
+  moving = false;
+  driver.RAMPMODE(limitSwitch.direction > 0 ? 1 : 2);
+
+  int32_t home;
+  bool found = find_limit(home);
+  end_velocity_mode();
+  if (limitSwitch.isSensorless) {
+    stop_on_stall(false);  // releases the motor after the stall
+    driver.TCOOLTHRS(0);
+  }
+  if (found) limitSwitch.offset = -home;
+  return found;
+}
+
+uint32_t StepperMotor::homing_speed() {
+  return config.homingSpeed > 0 ? config.homingSpeed : config.speed / 4;
+}
+
+// StallGuard only runs while TSTEP <= TCOOLTHRS. TSTEP is 2^24 / VACTUAL,
+// so this arms it once the motor passes half of vmax and keeps it quiet
+// while accelerating.
+void StepperMotor::setup_stallguard(uint32_t vmax, int threshold) {
+  uint32_t tstep = (1ul << 25) / vmax;
+  driver.TCOOLTHRS(tstep > 0xFFFFF ? 0xFFFFF : tstep);
+  driver.sgt(threshold);
+}
+
+void StepperMotor::stop_on_stall(bool enable) {
+  TMC5160Stepper::SW_MODE_t mode { 0 };
+  mode.sr = driver.SW_MODE();
+  mode.sg_stop = enable;
+  driver.SW_MODE(mode.sr);
+}
+
+// Finds the most sensitive StallGuard threshold that doesn't report a stall
+// while running freely at homing speed, and saves it in the limit switch.
+// SG_RESULT rises with sgt, so this is a binary search over -64..63. The
+// motor runs back and forth from where it starts, away from the hard stop
+// first, so leave some room on that side.
+int StepperMotor::tuneStallGuard() {
+  if (!isOnline()) return limitSwitch.stallThreshold;
+  stopJog();
+  while (leavingVelocityMode) check_velocity_stop();
+  RampParameters ramp = defaultRamp();
+  ramp.vmax = homing_speed();
+  setRamp(ramp);
+  moving = false;
+
+  int low = -64, high = 63;
+  int direction = -limitSwitch.direction;
+  while (low < high) {
+    int threshold = low + (high - low) / 2;
+    setup_stallguard(ramp.vmax, threshold);
+    if (sample_stallguard(direction) > stallGuardMargin) high = threshold;
+    else low = threshold + 1;
+    direction = -direction;
+  }
+
+  end_velocity_mode();
+  driver.TCOOLTHRS(0);
+  limitSwitch.stallThreshold = low;
+  return low;
+}
+
+// The lowest SG_RESULT seen while running at speed in the given direction
+uint16_t StepperMotor::sample_stallguard(int direction) {
+  driver.RAMPMODE(direction > 0 ? 1 : 2);
+  unsigned long start = millis();
+  while (!driver.velocity_reached() && millis() - start < homingTimeout);
+
+  uint16_t minimum = 1023;
+  for (int sample = 0; sample < stallGuardSamples; sample++) {
+    delay(blockDelay);
+    TMC5160Stepper::DRV_STATUS_t status { driver.DRV_STATUS() };
+    if (status.sg_result < minimum) minimum = status.sg_result;
+  }
+  return minimum;
+}
+
+// A stall is detected by the driver, which stops on its own. A hardware
+// switch latches XACTUAL into XLATCH on its edge, so the result
+// doesn't depend on how quickly this loop notices it. A switch on an MCU pin
+// can only be sampled.
+bool StepperMotor::find_limit(int32_t& home) {
+  unsigned long start = millis();
+  while (millis() - start < homingTimeout) {
+    if (limitSwitch.isSensorless) {
+      // sg_stop has already halted the motor at the hard stop
+      TMC5160Stepper::RAMP_STAT_t status { driver.RAMP_STAT() };
+      if (status.event_stop_sg) {
+        home = driver.XACTUAL();
+        return true;
+      }
+    } else if (limitSwitch.isHardware) {
+      TMC5160Stepper::RAMP_STAT_t status { driver.RAMP_STAT() };
+      if (limitSwitch.direction > 0 ? status.status_latch_r : status.status_latch_l) {
+        home = driver.XLATCH();
+        return true;
+      }
+    } else if (limitSwitch.isPressed()) {
+      home = driver.XACTUAL();
+      return true;
+    }
+  }
+  return false;
+}
+
+// Starts slowing down to a standstill in velocity mode. update() goes back
+// to positioning mode once the driver reports vzero, and a ramp or target
+// set in the meantime waits for it.
+void StepperMotor::stop_velocity_mode() {
+  RampParameters ramp = rampParameters;
+  ramp.vmax = 0;
+  write_ramp(ramp, false);
+  rampAfterStop = defaultRamp();
+  leavingVelocityMode = true;
+  velocityStopStart = millis();
+}
+
+// Goes back to positioning mode without moving once the motor is still, or
+// after velocityStopTimeout if vzero never comes. Hold mode also clears a
+// hardware stop event.
+void StepperMotor::check_velocity_stop() {
+  if (!leavingVelocityMode) return;
+  if (isOnline() && !driver.vzero() && millis() - velocityStopStart < velocityStopTimeout) return;
+  leavingVelocityMode = false;
+  driver.RAMPMODE(3);
+  state.xtarget = driver.XACTUAL();
+  driver.XTARGET(state.xtarget);
+  driver.RAMPMODE(0);
+  driver.RAMP_STAT(driver.RAMP_STAT());
+  write_ramp(rampAfterStop, false);
+  if (hasPendingTarget) write_target(pendingTarget);
+}
+
+// For homing and tuning, which can't go on until the motor has stopped
+void StepperMotor::end_velocity_mode() {
+  stop_velocity_mode();
+  while (leavingVelocityMode) check_velocity_stop();
 }
 
 void StepperMotor::update() {
-  int target = driver.XTARGET();
-  int current = driver.XACTUAL();
+  if (!isOnline()) return;
+  check_reset();
+  if (hasEncoder()) check_encoder();
+  if (leavingVelocityMode) {
+    check_velocity_stop();
+    return;
+  }
+  if (jogging) {
+    check_jog();
+    if (limitSwitch.isHardware && (diagEvent || pins.diag == -1)) handle_events();
+    return;
+  }
+  if (limitSwitch.isHardware) {
+    // The driver stops on its own, so only its events need handling
+    if (diagEvent || pins.diag == -1) handle_events();
+    return;
+  }
+
+  // A press shorter than the loop is still caught by the interrupt
+  limitSwitch.poll();
+  bool isPressed = limitEvent || limitSwitch.isPressed();
+  limitEvent = false;
+  if (!isPressed && !moving && !diagEvent) return;  // nothing to read for
+
+  int32_t target = driver.XTARGET();
+  int32_t current = driver.XACTUAL();
   bool isMovingTowardsLimit = limitSwitch.direction > 0
     ? target > current : target < current;
-  if (limitSwitch.isPressed() && limitSwitch.isBlocking && isMovingTowardsLimit) stop();
+  if (isPressed && limitSwitch.isBlocking && isMovingTowardsLimit) stop();
+
+  // The XACTUAL read above already returned the ramp status
+  TMC5160Stepper::SPI_STATUS_t status { driver.spi_status() };
+  if (diagEvent) handle_events();
+  else if (status.position_reached) finish_move();
 }
 
 void StepperMotor::stop() {
-  driver.XTARGET(driver.XACTUAL());
+  hasPendingTarget = false;
+  if (jogging || leavingVelocityMode) {
+    stopJog();
+    return;
+  }
+  state.xtarget = driver.XACTUAL();
+  driver.XTARGET(state.xtarget);
+}
+
+bool StepperMotor::isLimitPressed() {
+  if (!limitSwitch.isHardware) return limitSwitch.isPressed();
+  TMC5160Stepper::RAMP_STAT_t status { driver.RAMP_STAT() };
+  return limitSwitch.direction > 0 ? status.status_stop_r : status.status_stop_l;
+}
+
+// Where the motor was when the hardware switch last went active
+int StepperMotor::latchedSteps() {
+  return latch + limitSwitch.offset + homeSteps;
 }
 
 void StepperMotor::block() {
-  while (isMoving()) delay(blockDelay);
+  if (!isOnline()) return;
+  while (isMoving()) {
+    check_velocity_stop();
+    if (pins.diag == -1) {
+      delay(blockDelay);
+      if (limitSwitch.isHardware) handle_events();
+      continue;
+    }
+    // Wake up on the DIAG0 edge, but still re-check in case it was missed
+    wait_for_diag(blockDelay);
+    if (diagEvent) handle_events();
+  }
+  finish_move();
 }
 
 void StepperMotor::moveTo(double position) {
@@ -136,10 +752,162 @@ void StepperMotor::moveBy(double offset) {
 }
 
 void StepperMotor::moveToSteps(int steps) {
-  driver.XTARGET(steps);
+  setRamp(defaultRamp());  // undo any coordinated move
+  command_target(to_driver_steps(steps));
 }
 
 void StepperMotor::moveBySteps(int steps) {
-  int target = driver.XACTUAL() + steps;
-  driver.XTARGET(target);
+  setRamp(defaultRamp());
+  command_target(driver.XACTUAL() + steps);
+}
+
+// The inverse of currentSteps(): from the calibrated frame to XTARGET
+int32_t StepperMotor::to_driver_steps(int32_t steps) {
+  return steps - limitSwitch.offset - homeSteps;
+}
+
+static int32_t clamp_steps(double steps) {
+  if (steps <= minXactual) return minXactual;
+  if (steps >= maxXactual) return maxXactual;
+  return steps;
+}
+
+// Call again after changing the limit switch's position or bounds. setup()
+// and calibrate() do this already.
+void StepperMotor::update_limits() {
+  homeSteps = clamp_steps(limitSwitch.position * config.stepsPerUnit);
+  minSteps = clamp_steps(limitSwitch.minLimit * config.stepsPerUnit);
+  maxSteps = clamp_steps(limitSwitch.maxLimit * config.stepsPerUnit);
+}
+
+bool StepperMotor::is_within_limits(int32_t steps) {
+  return !limitSwitch.isAttached() || (steps >= minSteps && steps <= maxSteps);
+}
+
+// Skips the write if the driver already has this target, which is kept in
+// state.xtarget by every write and refresh. The move still counts as
+// started, so its completion is reported as before.
+void StepperMotor::write_target(int32_t steps) {
+  if (!isOnline()) return;
+  if (leavingVelocityMode) {  // sent once the motor is back in positioning mode
+    pendingTarget = steps;
+    hasPendingTarget = true;
+    return;
+  }
+  hasPendingTarget = false;  // superseded
+  if (steps != state.xtarget) driver.XTARGET(steps);
+  state.xtarget = steps;
+  moving = true;
+}
+
+// Moves from the public API. While deferred, only the latest target is
+// kept, so a burst of calls within one loop costs one write in flush().
+void StepperMotor::command_target(int32_t steps) {
+  if (!deferred) {
+    write_target(steps);
+    return;
+  }
+  pendingTarget = steps;
+  hasPendingTarget = true;
+}
+
+// Lets moveTo() and the other moves wait for flush(), for callers that send
+// the same target many times a second. Stopping is never deferred.
+void StepperMotor::deferMoves(bool enable) {
+  deferred = enable;
+  if (!enable) flush();
+}
+
+void StepperMotor::flush() {
+  if (hasPendingTarget) write_target(pendingTarget);
+}
+
+// Drives the motor in velocity mode from a stick deflection between -1 and
+// 1, for moving a joint by hand. Call it on every loop, even when the stick
+// is centered. A held stick writes nothing, so it's cheaper than stepping
+// XTARGET. Any move or stop() brings the motor back to positioning mode.
+void StepperMotor::jog(double deflection) {
+  if (!isOnline()) return;
+  int direction = deflection > 0 ? 1 : -1;
+  uint32_t velocity = jog_velocity(deflection);
+  if (direction == jogBlocked) velocity = 0;
+  if (!jogging) {
+    if (velocity == 0) return;
+    start_jog();
+  }
+  write_jog(velocity, direction);
+}
+
+// Slows down to a standstill, then update() goes back to positioning mode
+void StepperMotor::stopJog() {
+  if (!jogging) return;
+  jogging = false;
+  stop_velocity_mode();
+}
+
+bool StepperMotor::isJogging() {
+  return jogging;
+}
+
+void StepperMotor::start_jog() {
+  RampParameters ramp = defaultRamp();
+  ramp.vmax = 0;
+  write_ramp(ramp, false);
+  moving = false;  // a jog replaces any move in progress
+  hasPendingTarget = false;
+  leavingVelocityMode = false;  // picks up while the last jog slows down
+  jogging = true;
+  jogDirection = 0;
+  jogVelocity = 0;
+}
+
+// Removes the deadband, then blends in a cubic so small deflections give
+// fine control while a full deflection still reaches jog speed
+uint32_t StepperMotor::jog_velocity(double deflection) {
+  double magnitude = deflection < 0 ? -deflection : deflection;
+  if (magnitude <= config.jogDeadband) return 0;
+  if (magnitude > 1) magnitude = 1;
+  magnitude = (magnitude - config.jogDeadband) / (1 - config.jogDeadband);
+  magnitude = (1 - config.jogExpo) * magnitude + config.jogExpo * magnitude * magnitude * magnitude;
+  return jog_speed() * magnitude + 0.5;
+}
+
+uint32_t StepperMotor::jog_speed() {
+  return config.jogSpeed > 0 ? config.jogSpeed : defaultRamp().vmax;
+}
+
+// The driver ramps between VMAX values with AMAX on its own, so writes can
+// be sparse: stopping and reversing go out at once, big changes at most
+// every jogInterval, and small ones only after jogSettleTime.
+void StepperMotor::write_jog(uint32_t velocity, int direction) {
+  if (velocity == 0) direction = jogDirection;  // no need to change RAMPMODE to stop
+  if (velocity == jogVelocity && direction == jogDirection) return;
+
+  unsigned long now = millis();
+  if (velocity != 0 && direction == jogDirection) {
+    uint32_t change = velocity > jogVelocity ? velocity - jogVelocity : jogVelocity - velocity;
+    unsigned long wait = change * jogResolution < jog_speed() ? jogSettleTime : jogInterval;
+    if (now - lastJogWrite < wait) return;
+  }
+
+  if (direction != jogDirection) driver.RAMPMODE(direction > 0 ? 1 : 2);
+  driver.VMAX(velocity);
+  rampParameters.vmax = velocity;
+  jogDirection = direction;
+  jogVelocity = velocity;
+  lastJogWrite = now;
+}
+
+// Velocity mode has no target, so the limits are checked here. The motor
+// ramps down from where they're crossed, so it ends up a little past them.
+void StepperMotor::check_jog() {
+  jogBlocked = 0;
+  if (!limitSwitch.isAttached()) return;
+  if (!limitSwitch.isHardware && limitSwitch.isBlocking && limitSwitch.isPressed()) {
+    jogBlocked = limitSwitch.direction > 0 ? 1 : -1;
+  }
+  int32_t steps = driver.XACTUAL() + limitSwitch.offset + homeSteps;
+  if (steps >= maxSteps) jogBlocked = 1;
+  if (steps <= minSteps) jogBlocked = -1;
+  if (jogBlocked != 0 && jogBlocked == jogDirection) write_jog(0, jogDirection);
 }
@@ -3,19 +3,19 @@
 #include "TmcStepper.h"
 
 #include "limit.h"
+#include "interrupt.h"
+#include "ring_buffer.h"
+#include "ramp.h"
+#include "position.h"
 
-const double pi = 3.141592653589793;
-const int microstepsPerStep = 256;
-const int stepsPerRotation = 200;
-const int degreesPerRotation = 360;
-const double radiansPerRotation = 2 * pi;
-
-const double microstepsPerRadian = microstepsPerStep * stepsPerRotation / radiansPerRotation;
-const double microstepsPerDegree = microstepsPerStep * stepsPerRotation / degreesPerRotation;
+const int32_t minXactual = -2147483647 - 1;  // XACTUAL is a signed 32 bit register
+const int32_t maxXactual = 2147483647;
+const unsigned long resetDelay = 1000;  // ms the driver stays disabled after a reset
 
 struct StepperMotorPins {
   int enable;
   int chipSelect;
+  int diag;  // DIAG0, used as the ramp event interrupt, 0 if it isn't wired
 };
 
 struct StepperMotorConfig {
@@ -24,38 +24,225 @@ struct StepperMotorConfig {
   int speed;
   int acceleration;
   double stepsPerUnit;
+  // Everything below is optional. Unset fields are 0 and get the defaults
+  // noted, which keeps the struct an aggregate under C++11. The jog and idle
+  // fields take 0 as it is, so set the suggested values to use them.
+  int homingSpeed;  // VMAX while homing, 0 uses a quarter of speed
+  double encoderCountsPerUnit;  // 0 if there's no encoder
+  int maxDeviation;  // microsteps between XACTUAL and X_ENC, 0 for 1024
+  double clockFrequency;  // Hz, set if CLK is driven externally, 0 for the internal clock
+  float rsense;  // Ω, the sense resistor on the driver board, 0 for 0.075
+  SPIClass* spi;  // the bus the driver is on, nullptr for SPI
+  int jogSpeed;  // VMAX at full stick, 0 uses the default ramp's
+  double jogDeadband;  // stick deflection that's ignored, 0 for none, 0.1 suits most sticks
+  double jogExpo;  // 0 is linear, 1 cubic for finer control near the center, 0.5 suits most joints
+  int boostCurrent;  // mA while accelerating, 0 for no boost
+  int holdCurrent;  // mA at standstill, 0 for half of current
+  int idleCurrent;  // mA once idleTime has passed at standstill, 0 for holdCurrent
+  unsigned long idleTime;  // ms, 0 idles at once, 2000 suits most joints
+};
+
+struct MotionState {
+  int32_t xactual = 0;
+  int32_t xtarget = 0;
+  int32_t vactual = 0;
+  uint16_t rampStat = 0;
+  uint32_t drvStatus = 0;
+  unsigned long timestamp = 0;  // ms, 0 until the first read
+};
+
+// The result of checking IOIN after a reset
+enum class DriverStatus { unknown, ok, noResponse, stepDirMode, notEnabled };
+
+const char* describeStatus(DriverStatus status);
+
+// A step loss caught by the encoder, before it was corrected
+struct DeviationEvent {
+  int32_t xactual;  // where the driver thought it was
+  int32_t xenc;     // where the encoder says it is
+  unsigned long timestamp;  // ms
 };
 
+const int deviationLogSize = 8;
+
+class StepperMotor;
+using MotorCallback = void (*)(StepperMotor& motor);
+
 class StepperMotor {
+  friend class Arm;
+  friend class Trajectory;
+  friend class HealthMonitor;
+
   private: 
     StepperMotorPins pins;
     StepperMotorConfig config;
+    ChipClock clock;
 		TMC5160Stepper driver;
 
-    void reset_driver();
-    void check_driver();
+    DriverStatus driverStatus = DriverStatus::unknown;
+    MotionState state;
+    RampParameters rampParameters {};
+    RampParameters plannedRamp {};  // from setLimits(), unused while vmax is 0
+
+    // The limit switch in steps, so the integer paths never touch a double
+    int32_t homeSteps = 0;
+    int32_t minSteps = minXactual;
+    int32_t maxSteps = maxXactual;
+    int32_t latch = 0;
+    volatile bool diagEvent = false;
+    volatile bool limitEvent = false;  // the switch was pressed since the last update()
+    bool moving = false;
+    MotorCallback moveCompleteCallback = nullptr;
+    MotorCallback stallCallback = nullptr;
+    MotorCallback deviationCallback = nullptr;
+    MotorCallback resetCallback = nullptr;
+    unsigned long totalResets = 0;
+
+    RingBuffer<DeviationEvent, deviationLogSize> deviations;
+    unsigned long totalDeviations = 0;
+    unsigned long lastEncoderCheck = 0;
+
+    bool jogging = false;
+    int jogDirection = 0;  // of the current RAMPMODE, 0 before the first write
+    int jogBlocked = 0;  // direction that would leave the limits
+    uint32_t jogVelocity = 0;  // last VMAX written
+    unsigned long lastJogWrite = 0;
+
+    // Slowing down in velocity mode before going back to positioning mode
+    bool leavingVelocityMode = false;
+    unsigned long velocityStopStart = 0;  // ms
+    RampParameters rampAfterStop {};
+
+    // IHOLD_IRUN for each phase, worked out once in setup_current()
+    uint32_t boostCurrentWord = 0;
+    uint32_t runCurrentWord = 0;
+    uint32_t idleCurrentWord = 0;
+    uint32_t currentWord = 0;  // last written
+    uint32_t lastSpeed = 0;  // |VACTUAL| at the last refresh
+    unsigned long lastMotion = 0;  // ms
+    unsigned long lastHeatUpdate = 0;  // ms
+    int32_t heat = 0;  // filtered (CS + 1)² << 16
+
+    bool deferred = false;  // moves wait for flush()
+    bool hasPendingTarget = false;
+    int32_t pendingTarget = 0;
+
+    void start_reset();
+    void end_reset();
+    void configure();
+    DriverStatus check_driver();
     void write_settings();
+    void setup_current();
+    uint8_t current_scale(int current, int peak, uint8_t peakScale);
+    void update_current();
+    void update_heat(uint32_t word, bool standstill);
+    void write_ramp(const RampParameters& ramp, bool force);
+    void write_target(int32_t steps);
+    void command_target(int32_t steps);
+    void setup_diag();
+    void setup_limit();
+    void setup_encoder();
+    void check_encoder();
+    bool check_reset();
+    void recover_from_reset();
+    void stop_at_limit();
+    bool find_limit(int32_t& home);
+    void stop_velocity_mode();
+    void check_velocity_stop();
+    void end_velocity_mode();
+    void start_jog();
+    uint32_t jog_velocity(double deflection);
+    uint32_t jog_speed();
+    void write_jog(uint32_t velocity, int direction);
+    void check_jog();
+    uint32_t homing_speed();
+    void setup_stallguard(uint32_t vmax, int threshold);
+    void stop_on_stall(bool enable);
+    uint16_t sample_stallguard(int direction);
+    int32_t to_driver_steps(int32_t steps);
+    void update_limits();
+    bool is_within_limits(int32_t steps);
+    void handle_events();
+    void finish_move();
+    void wait_for_diag(unsigned long timeout);
+    static void on_diag(void* context);
+    static void on_limit(void* context);
 
   public: 
     LimitSwitch limitSwitch;
     StepperMotor(StepperMotorPins pins, StepperMotorConfig config);
     StepperMotor(StepperMotorPins pins, StepperMotorConfig config, LimitSwitch limitSwitch);
 
+    DriverStatus status();
+    bool isOnline();
     bool isMoving();
-    int currentSteps();
-    int targetSteps();
-    double currentPosition();
-    double targetPosition();
+    int currentSteps(bool forceRead = false);
+    int targetSteps(bool forceRead = false);
+    double currentPosition(bool forceRead = false);
+    double targetPosition(bool forceRead = false);
+    double currentVelocity(bool forceRead = false);
+
+    void refresh();
+    const MotionState& motionState(bool forceRead = false);
 
     void presetup();
-    void setup();
-    void calibrate();
+    bool setup();
+    bool calibrate();
+    int tuneStallGuard();
     void update();
     void stop();
     void block();
+    bool isLimitPressed();
+    int latchedSteps();
+
+    RampParameters defaultRamp();
+    const RampParameters& ramp();
+    void setRamp(const RampParameters& ramp);
+    void setLimits(const MotionLimits& limits);
+    double predictMoveTime(int steps);
+
+    void onMoveComplete(MotorCallback callback);
+    void onStall(MotorCallback callback);
+    void onDeviation(MotorCallback callback);
+    void onReset(MotorCallback callback);
+    unsigned long resetCount();
+    int thermalLoad();
+
+    bool hasEncoder();
+    unsigned long deviationCount();
+    bool nextDeviation(DeviationEvent& event);
 
     void moveTo(double position);
     void moveBy(double offset);
     void moveToSteps(int steps);
     void moveBySteps(int steps);
+
+    void deferMoves(bool enable);
+    void flush();
+
+    void jog(double deflection);
+    void stopJog();
+    bool isJogging();
+
+    template<int32_t microsteps, int32_t units>
+    bool moveTo(FixedPosition<microsteps, units> position);
+    template<int32_t microsteps, int32_t units>
+    bool currentPosition(FixedPosition<microsteps, units>& position, bool forceRead = false);
 };
+
+// Moves without any floating point. The position type's ratio should match
+// config.stepsPerUnit. Returns false if the position is out of bounds.
+template<int32_t microsteps, int32_t units>
+bool StepperMotor::moveTo(FixedPosition<microsteps, units> position) {
+  int32_t steps;
+  if (!position.toSteps(steps) || !is_within_limits(steps)) return false;
+  setRamp(defaultRamp());
+  command_target(to_driver_steps(steps));  // int is only 16 bits on AVR
+  return true;
+}
+
+template<int32_t microsteps, int32_t units>
+bool StepperMotor::currentPosition(FixedPosition<microsteps, units>& position, bool forceRead) {
+  int32_t steps = motionState(forceRead).xactual + limitSwitch.offset + homeSteps;
+  return FixedPosition<microsteps, units>::fromSteps(steps, position);
+}
@@ -66,8 +66,46 @@ class TMCStepper {
 		TYPE& self() { return *static_cast<TYPE*>(this); } 
 };
 
+// Current scale lookups, filled once per Rsense. The current is proportional
+// to CS + 1, so one table of the current at every CS answers both ways:
+// cs2rms() is a lookup and rms_current() a binary search.
+namespace TMC_RMS_n {
+
+typedef uint16_t CS_table[32];  // mA at CS 0..31, rounded down
+
+// mA at CS is (CS + 1) * numerator / denominator. Only runs at construction.
+inline void fill_table(CS_table &table, const uint64_t numerator, const uint64_t denominator) {
+  for (uint8_t CS = 0; CS < 32; CS++) {
+    const uint64_t mA = (CS + 1) * numerator / denominator;
+    table[CS] = mA > 0xFFFF ? 0xFFFF : mA;
+  }
+}
+
+// CS + 1 for the highest CS whose current is below mA, so CS + 1 is the
+// integer part of the exact 32*sqrt(2)*I_rms*R/V_fs
+inline uint8_t find_steps(const CS_table &table, const uint16_t mA) {
+  if (table[31] < mA) return 32;
+  uint8_t steps = 0;
+  for (uint8_t step = 16; step > 0; step >>= 1) {
+    if (table[steps + step - 1] < mA) steps += step;
+  }
+  return steps;
+}
+
+// IHOLD as CS*hold_multiplier(), in integers
+inline uint8_t hold_scale(const uint8_t CS, const uint8_t holdMultiplier) {
+  return (uint16_t)CS * (2*holdMultiplier + 1) / 510;
+}
+
+}
+
 namespace TMC2130_n {
 
+// V_fs is 0.325V, or 0.180V with vsense, and 0.02 ohm is added to R_sense.
+// In integers, R_sense + 0.02 = (10*Rsense + 51) / 2550 and sqrt(2) = 1.41421.
+constexpr uint64_t table_numerator(const uint16_t V_fs_mV) { return V_fs_mV * 255000000ull; }
+constexpr uint64_t table_denominator(const uint8_t Rsense) { return 4525472ull * (10*Rsense + 51); }
+
 template<class T>
 struct TMC_RMS {
     uint16_t cs2rms(const uint8_t CS);
@@ -82,17 +120,34 @@ struct TMC_RMS {
     void hold_multiplier(const float val) { holdMultiplier = val*255; }
     float hold_multiplier() const { return (holdMultiplier+0.5)/255.0; }
   protected:
-    TMC_RMS(const float RS) : Rsense(RS*255) {};
+    TMC_RMS(const float RS) : Rsense(RS*255) {
+      TMC_RMS_n::fill_table(csTable[0], table_numerator(325), table_denominator(Rsense));
+      TMC_RMS_n::fill_table(csTable[1], table_numerator(180), table_denominator(Rsense));
+    };
     T& self() { return *static_cast<T*>(this); }
 
     const uint8_t Rsense;
     uint8_t holdMultiplier = 127;
+    TMC_RMS_n::CS_table csTable[2];  // by vsense
 };
 
 }
 
 namespace TMC2160_n {
 
+// The parts of rms_current() and cs2rms() that only depend on R_sense
+inline uint32_t scaled_rsense(const uint8_t Rsense) {
+  const float rs = Rsense/255.0;
+  const uint16_t RS_scaled = rs * 0xFFFF; // Scale to 16b
+  return 11585ul * RS_scaled >> 8; // 32 * 256 * sqrt(2)
+}
+
+inline uint32_t rms_denominator(const uint8_t Rsense) {
+  const float rs = Rsense/255.0;
+  uint32_t denominator = rs*1000;
+  return denominator * 1414;
+}
+
 template<class T>
 struct TMC_RMS {
     uint16_t cs2rms(const uint8_t CS);
@@ -107,10 +162,16 @@ struct TMC_RMS {
     void hold_multiplier(const float val) { holdMultiplier = val*255; }
     float hold_multiplier() const { return (holdMultiplier+0.5)/255.0; }
   protected:
-    TMC_RMS(const float RS) : Rsense(RS*255) {};
+    TMC_RMS(const float RS) :
+      Rsense(RS*255),
+      scaledRsense(scaled_rsense(Rsense)),
+      rmsDenominator(rms_denominator(Rsense))
+      {};
     T& self() { return *static_cast<T*>(this); }
 
     const uint8_t Rsense;
+    const uint32_t scaledRsense;
+    const uint32_t rmsDenominator;
     uint8_t holdMultiplier = 127;
 };
 
@@ -118,6 +179,11 @@ struct TMC_RMS {
 
 namespace TMC2300_n {
 
+// As for the TMC2130, but with a fixed V_fs and 0.03 ohm added to R_sense:
+// R_sense + 0.03 = (20*Rsense + 153) / 5100
+constexpr uint64_t table_numerator() { return 325 * 510000000ull; }
+constexpr uint64_t table_denominator(const uint8_t Rsense) { return 4525472ull * (20*Rsense + 153); }
+
 template<class T>
 struct TMC_RMS {
     uint16_t cs2rms(const uint8_t CS);
@@ -132,11 +198,14 @@ struct TMC_RMS {
     void hold_multiplier(const float val) { holdMultiplier = val*255; }
     float hold_multiplier() const { return (holdMultiplier+0.5)/255.0; }
   protected:
-    TMC_RMS(const float RS) : Rsense(RS*255) {};
+    TMC_RMS(const float RS) : Rsense(RS*255) {
+      TMC_RMS_n::fill_table(csTable, table_numerator(), table_denominator(Rsense));
+    };
     T& self() { return *static_cast<T*>(this); }
 
     const uint8_t Rsense;
     uint8_t holdMultiplier = 127;
+    TMC_RMS_n::CS_table csTable;
 };
 
 }
@@ -948,6 +1017,7 @@ class TMC2660Stepper : TMC2660_n::TMC_SPI {
 		READ_RDSEL10_t READ_RDSEL10_register{{.sr=0}};
 
 		const float Rsense;
+		TMC_RMS_n::CS_table csTable[2];  // by vsense
 		static constexpr float default_RS = 0.1;
 		float holdMultiplier = 0.5;
 		uint32_t spi_speed = 16000000/8; // Default 2MHz
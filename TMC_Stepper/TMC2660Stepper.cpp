@@ -4,15 +4,29 @@
 using namespace TMCStepper_n;
 using namespace TMC_HAL;
 
+// The current at every CS, rounded down like cs2rms() used to
+static void fill_table(TMC_RMS_n::CS_table &table, const float V_fs, const float RS) {
+  for (uint8_t CS = 0; CS < 32; CS++) {
+    const float mA = (float)(CS+1)/32.0 * V_fs/RS / 1.41421 * 1000;
+    table[CS] = mA > 0xFFFF ? 0xFFFF : mA;
+  }
+}
+
 TMC2660Stepper::TMC2660Stepper(SPIClass &spi, PinDef cs, const float RS, const int8_t link_index) :
   TMC_SPI(spi, cs, link_index),
   Rsense(RS)
-  {}
+  {
+    fill_table(csTable[0], 0.310, Rsense);
+    fill_table(csTable[1], 0.165, Rsense);
+  }
 
 TMC2660Stepper::TMC2660Stepper(SW_SPIClass &spi, PinDef cs, const float RS, const int8_t link_index) :
   TMC_SPI(spi, cs, link_index),
   Rsense(RS)
-  {}
+  {
+    fill_table(csTable[0], 0.310, Rsense);
+    fill_table(csTable[1], 0.165, Rsense);
+  }
 
 using namespace TMC2660_n;
 
@@ -50,29 +64,28 @@ uint8_t TMC2660Stepper::test_connection() {
   ->
   CS = 32*sqrt(2)*1.65*0.100/0.310 - 1 = 24,09
   CS = 24
+
+  The tables hold the current at every CS, rounded down, see TMC_RMS_n.
 */
 
 uint16_t TMC2660Stepper::cs2rms(const uint8_t CS) const {
-  return (float)(CS+1)/32.0 * (vsense() ? 0.165 : 0.310)/(Rsense+0.02) / 1.41421 * 1000;
+  return csTable[vsense()][CS & 31];
 }
 
 uint16_t TMC2660Stepper::rms_current() const {
   return cs2rms(cs());
 }
 void TMC2660Stepper::rms_current(const uint16_t mA) {
-  uint8_t CS = 32.0*1.41421*mA/1000.0*Rsense/0.310 - 1;
+  uint8_t steps = TMC_RMS_n::find_steps(csTable[0], mA); // CS + 1
   // If Current Scale is too low, turn on high sensitivity R_sense and calculate again
-  if (CS < 16) {
+  if (steps <= 16) {
     vsense(true);
-    CS = 32.0*1.41421*mA/1000.0*Rsense/0.165 - 1;
+    steps = TMC_RMS_n::find_steps(csTable[1], mA);
   } else { // If CS >= 16, turn off high_sense_r
     vsense(false);
   }
 
-  if (CS > 31)
-    CS = 31;
-
-  cs(CS);
+  cs(steps > 0 ? steps - 1 : 0);
   //val_mA = mA;
 }
 
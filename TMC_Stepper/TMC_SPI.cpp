@@ -89,6 +89,46 @@ uint32_t TMC_SPI::read(uint8_t addressByte) {
   return data.data;
 }
 
+TMC_WEAK_FUNCTION
+void TMC_SPI::readBatch(const uint8_t addressBytes[], uint32_t values[], const uint8_t count) {
+  if (count == 0) return;
+
+  // Pipelining only works when the reply comes straight back to the MCU
+  if (link_index > 0) {
+    for (uint8_t i = 0; i < count; i++) {
+      values[i] = read(addressBytes[i]);
+    }
+    return;
+  }
+
+  OutputPin cs(pinCS);
+
+  beginTransaction();
+
+  // Each datagram returns the register requested by the previous one
+  for (uint8_t i = 0; i <= count; i++) {
+    TransferData data;
+    data.address = addressBytes[i < count ? i : count - 1];
+
+    delay_ns(20);
+    cs.write(LOW);
+    delay_ns(200);
+
+    transfer(data.buffer, 5);
+
+    delay_ns(200);
+    cs.write(HIGH);
+
+    if (i > 0) {
+      values[i - 1] = __builtin_bswap32(data.data);
+      status_response = data.status;
+    }
+  }
+
+  endTransaction();
+  delay_ns(20);
+}
+
 TMC_WEAK_FUNCTION
 void TMC_SPI::write(const uint8_t addressByte, const uint32_t config) {
   OutputPin cs(pinCS);
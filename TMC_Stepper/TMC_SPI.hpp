@@ -92,6 +92,7 @@ protected:
 	template<class> friend class TMC5160_n::SLAVECONF_i;
 	template<class> friend class TMC5160_n::IOIN_i;
 	template<class> friend class TMC5160_n::ENC_DEVIATION_i;
+	template<class> friend class TMC5160_n::ENC_STATUS_i;
 	template<class> friend class TMC5160_n::DRV_STATUS_i;
 
 	template<class> friend class TMC2208_n::SLAVECONF_i; // For TMC5130
@@ -119,9 +120,33 @@ protected:
   #pragma pack(pop)
 
 public:
+	// Status bits returned with every datagram (TMC5130/TMC5160 layout)
+	#pragma pack(push, 1)
+	union SPI_STATUS_t {
+		uint8_t sr;
+		struct {
+			bool  reset_flag : 1,
+			      driver_error : 1,
+			      sg2 : 1,
+			      standstill : 1,
+			      velocity_reached : 1,
+			      position_reached : 1,
+			      status_stop_l : 1,
+			      status_stop_r : 1;
+		};
+	};
+	#pragma pack(pop)
+
 	void begin();
 	void initPeripheral();
 
+	// Status of the last transfer, no bus access
+	uint8_t spi_status() const { return status_response; }
+
+	// Reads several registers with one datagram each plus one extra,
+	// instead of two datagrams per register
+	void readBatch(const uint8_t addressBytes[], uint32_t values[], const uint8_t count);
+
 	void setSPISpeed(uint32_t speed);
 	void switchCSpin(bool state);
 
@@ -133,7 +158,7 @@ protected:
 	void write(const uint8_t addressByte, const uint32_t config);
 	uint32_t read(const uint8_t addressByte);
 
-	uint8_t status_response;
+	uint8_t status_response = 0;
 
 	static constexpr uint8_t TMC_READ = 0x00,
 													TMC_WRITE = 0x80;
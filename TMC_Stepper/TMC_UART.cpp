@@ -50,7 +50,7 @@ void TMC_UART::write(const uint8_t addr, const uint32_t regVal) {
     datagram.crc = calcCRC((uint8_t*)&datagram, datagram.length);
 
 	preWriteCommunication();
-	serial_write((uint8_t*)&datagram, datagram.length);
+	stats.bytesWritten += serial_write((uint8_t*)&datagram, datagram.length);
 	postWriteCommunication();
 
 	lastWriteTime = getTime();
@@ -69,6 +69,7 @@ TMC_UART::ReadResponse TMC_UART::sendReadRequest(ReadRequest &datagram) {
 	while (byteCount != datagram.length && Timeout()) {
 		byteCount = serial_write((uint8_t*)&datagram, datagram.length);
 	}
+	stats.bytesWritten += byteCount;
 
     // scan for the rx frame and read it
     const uint32_t sync_target = static_cast<uint32_t>(datagram.sync)<<16 | 0xFF00 | datagram.registerAddress;
@@ -79,7 +80,7 @@ TMC_UART::ReadResponse TMC_UART::sendReadRequest(ReadRequest &datagram) {
     do {
         if (available() > 0) {
 		    sync <<= 8;
-		    serial_read((uint8_t*)&sync, 1);
+		    stats.bytesRead += serial_read((uint8_t*)&sync, 1);
         }
     } while (((sync&0xFFFFFF) != sync_target) && Timeout());
 
@@ -88,18 +89,23 @@ TMC_UART::ReadResponse TMC_UART::sendReadRequest(ReadRequest &datagram) {
 	        response.driverAddress = 0xFF;
 	    	response.registerAddress = static_cast<uint8_t>(sync);
 
-	    	serial_read((uint8_t*)&response.data, 5);
+	    	stats.bytesRead += serial_read((uint8_t*)&response.data, 5);
 	    	break;
 		}
 	};
 
+	// driverAddress is only filled in once a full frame has arrived
+	if (response.driverAddress != 0xFF) {
+		stats.timeouts++;
+	}
+
 	lastWriteTime = getTime();
 
     return response;
 }
 
 uint32_t TMC_UART::read(const uint8_t addr) {
-    ReadResponse response;
+    ReadResponse response{};
     ReadRequest datagram;
     datagram.driverAddress = slaveAddress;
     datagram.registerAddress = addr | TMC_READ;
@@ -107,7 +113,11 @@ uint32_t TMC_UART::read(const uint8_t addr) {
     datagram.crc = calcCRC((uint8_t*)&datagram, datagram.length);
     CRCerror = true;
 
-    for (uint_fast8_t i = 0; i < max_retries; i++) {
+    for (uint_fast8_t i = 0; i < attempts; i++) {
+        if (i > 0) {
+            stats.retries++;
+        }
+
         preReadCommunication();
         response = sendReadRequest(datagram);
         postReadCommunication();
@@ -119,7 +129,12 @@ uint32_t TMC_UART::read(const uint8_t addr) {
             break;
         }
 
+        if (response.driverAddress == 0xFF) {
+            stats.crcErrors++;
+        }
+
         response.data = 0;
+        if (i + 1 == attempts) break; // no point waiting after the last try
 
 		const uint32_t startTime = getTime();
 		while(getTime() - startTime < 20);
@@ -128,6 +143,45 @@ uint32_t TMC_UART::read(const uint8_t addr) {
     return __builtin_bswap32(response.data);
 }
 
+bool TMC_UART::testLink(const uint8_t trials) {
+	for (uint8_t i = 0; i < trials; i++) {
+		const uint8_t ifcnt = read(TMC2208_n::IFCNT_t::address);
+		if (CRCerror) return false;
+
+		read(TMC2208_n::IOIN_t::address);
+		if (CRCerror) return false;
+
+		// Writing GCONF back unchanged must be counted by IFCNT
+		const uint32_t gconf = read(TMC2208_n::GCONF_t::address);
+		if (CRCerror) return false;
+		write(TMC2208_n::GCONF_t::address, gconf);
+
+		const uint8_t count = read(TMC2208_n::IFCNT_t::address);
+		if (CRCerror || uint8_t(count - ifcnt) != 1) return false;
+	}
+	return true;
+}
+
+uint32_t TMC_UART::autoBaud(const uint32_t baudrates[], const uint8_t count, const uint8_t trials) {
+	uint32_t best = 0;
+
+	for (uint8_t i = 0; i < count; i++) {
+		if (baudrates[i] <= best) continue;
+
+		begin(baudrates[i]);
+		const LinkStats before = stats;
+		if (testLink(trials) && stats.crcErrors == before.crcErrors && stats.timeouts == before.timeouts) {
+			best = baudrates[i];
+		}
+	}
+
+	if (best != 0) {
+		begin(best);
+	}
+
+	return best;
+}
+
 SSwitch::SSwitch(const PinDef pin1, const PinDef pin2) :
 	p1(pin1),
 	p2(pin2)
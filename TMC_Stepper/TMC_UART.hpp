@@ -19,6 +19,33 @@ class SSwitch {
 struct TMC_UART {
   void begin(uint32_t baudrate);
 
+  // Tries each baud rate and keeps the fastest one that passes every trial.
+  // Returns 0 if no rate worked.
+  uint32_t autoBaud(const uint32_t baudrates[], const uint8_t count, const uint8_t trials = 10);
+  bool testLink(const uint8_t trials);
+
+  struct LinkStats {
+    uint32_t crcErrors = 0;
+    uint32_t timeouts = 0;
+    uint32_t retries = 0;
+    uint32_t bytesWritten = 0;
+    uint32_t bytesRead = 0;
+  };
+
+  const LinkStats& linkStats() const { return stats; }
+  void resetLinkStats() { stats = LinkStats{}; }
+
+  // True once a write can go out without waiting for the inhibit time
+  bool writeReady() const { return getTime() - lastWriteTime >= WriteInhibitTime; }
+
+  // How many times a read is sent before it gives up and returns 0, from 1
+  // to max_retries. Each failed try blocks for up to abort_window ms.
+  void readAttempts(const uint8_t count) { attempts = count < 1 ? 1 : count > max_retries ? max_retries : count; }
+  uint8_t readAttempts() const { return attempts; }
+
+  // True if the last read got no valid reply, so the 0 it returned is not data
+  bool readFailed() const { return CRCerror; }
+
 protected:
 
   template<class> friend class TMCStepper;
@@ -127,8 +154,9 @@ protected:
 
   ReadResponse sendReadRequest(ReadRequest &datagram);
 
-  uint16_t bytesWritten = 0;
+  LinkStats stats;
   bool CRCerror = false;
+  uint8_t attempts = max_retries;
 
   void WaitForInhibitTime() const;
 
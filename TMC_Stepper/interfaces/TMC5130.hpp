@@ -397,7 +397,7 @@ namespace TMC5130_n {
       void sg_stop(const bool B)          { SW_MODE_t r{ SW_MODE() }; r.sg_stop = B;          SW_MODE(r.sr); }
       void en_softstop(const bool B)      { SW_MODE_t r{ SW_MODE() }; r.en_softstop = B;      SW_MODE(r.sr); }
 
-      bool stop_l_enable()          { return SW_MODE_t{ SW_MODE() }.stop_r_enable;    }
+      bool stop_l_enable()          { return SW_MODE_t{ SW_MODE() }.stop_l_enable;    }
       bool stop_r_enable()          { return SW_MODE_t{ SW_MODE() }.stop_r_enable;    }
       bool pol_stop_l()             { return SW_MODE_t{ SW_MODE() }.pol_stop_l;       }
       bool pol_stop_r()             { return SW_MODE_t{ SW_MODE() }.pol_stop_r;       }
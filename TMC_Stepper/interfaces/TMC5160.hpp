@@ -202,7 +202,6 @@ namespace TMC5160_n {
     using TMC5130_n::ENCMODE_t;
     using TMC5130_n::X_ENC_t;
     using TMC5130_n::ENC_CONST_t;
-    using TMC5130_n::ENC_STATUS_t;
     using TMC5130_n::ENC_LATCH_t;
     using TMC5130_n::OUTPUT_i;
     using TMC5130_n::X_COMPARE_i;
@@ -239,7 +238,6 @@ namespace TMC5160_n {
     using TMC5130_n::ENCMODE_i;
     using TMC5130_n::X_ENC_i;
     using TMC5130_n::ENC_CONST_i;
-    using TMC5130_n::ENC_STATUS_i;
     using TMC5130_n::ENC_LATCH_i;
     
     #pragma pack(push, 1)
@@ -261,6 +259,33 @@ namespace TMC5160_n {
             ENC_DEVIATION_t r{};
     };
 
+    // 0x3B R+WC: ENC_STATUS, the 5160 adds deviation_warn
+    #pragma pack(push, 1)
+    struct ENC_STATUS_t {
+        ENC_STATUS_t(const uint8_t data) : sr(data) {};
+        constexpr static uint8_t address = 0x3B;
+        union {
+            uint8_t sr : 2;
+            struct {
+                bool    n_event : 1,
+                        deviation_warn : 1;
+            };
+        };
+    };
+    #pragma pack(pop)
+
+    template<typename TYPE>
+    struct ENC_STATUS_i {
+        uint8_t ENC_STATUS() {
+            return static_cast<TYPE*>(this)->read(ENC_STATUS_t::address);
+        }
+        void ENC_STATUS(const uint8_t input) {
+            static_cast<TYPE*>(this)->write(ENC_STATUS_t::address, input);
+        }
+        bool n_event()          { return ENC_STATUS_t{ ENC_STATUS() }.n_event;        }
+        bool deviation_warn()   { return ENC_STATUS_t{ ENC_STATUS() }.deviation_warn; }
+    };
+
     using TMC2130_n::MSLUT0_t;
     using TMC2130_n::MSLUT1_t;
     using TMC2130_n::MSLUT2_t;
@@ -15,31 +15,29 @@
   ->
   CS = 32*sqrt(2)*1.64*(0.10+0.02)/0.325 - 1 = 26.4
   CS = 26
+
+  The tables hold the current at every CS, rounded down, see TMC_RMS_n.
 */
 template<class T>
 uint16_t TMC2130_n::TMC_RMS<T>::cs2rms(const uint8_t CS) {
-  const float rs = Rsense/255.0+0.02;
-  return (float)(CS+1)/32.0 * (self().vsense() ? 0.180 : 0.325)/rs / 1.41421 * 1000;
+  return csTable[self().vsense()][CS & 31];
 }
 
 template<class T>
 void TMC2130_n::TMC_RMS<T>::rms_current(const uint16_t mA) {
-  const float rs = Rsense/255.0+0.02;
-  uint8_t CS = 32.0*1.41421*mA/1000.0*rs/0.325 - 1;
+  uint8_t steps = TMC_RMS_n::find_steps(csTable[0], mA); // CS + 1
   // If Current Scale is too low, turn on high sensitivity R_sense and calculate again
-  if (CS < 16) {
+  if (steps <= 16) {
     self().vsense(true);
-    CS = 32.0*1.41421*mA/1000.0*rs/0.180 - 1;
+    steps = TMC_RMS_n::find_steps(csTable[1], mA);
   } else { // If CS >= 16, turn off high_sense_r
     self().vsense(false);
   }
-
-  if (CS > 31)
-    CS = 31;
+  const uint8_t CS = steps > 0 ? steps - 1 : 0;
 
   typename T::IHOLD_IRUN_t r{ self().IHOLD_IRUN() };
   r.irun = CS;
-  r.ihold = CS*hold_multiplier();
+  r.ihold = TMC_RMS_n::hold_scale(CS, holdMultiplier);
   self().IHOLD_IRUN(r.sr);
   //val_mA = mA;
 }
@@ -62,21 +60,17 @@ void TMC2130_n::TMC_RMS<T>::rms_current(const uint16_t mA) {
 */
 template<class T>
 uint16_t TMC2300_n::TMC_RMS<T>::cs2rms(const uint8_t CS) {
-  const float rs = Rsense/255.0+0.03;
-  return (CS+1.0)/32.0 * 0.325/rs / 1.41421 * 1000;
+  return csTable[CS & 31];
 }
 
 template<class T>
 void TMC2300_n::TMC_RMS<T>::rms_current(const uint16_t mA) {
-  const float rs = Rsense/255.0+0.03;
-  uint8_t CS = 32.0*1.41421*mA/1000.0*rs/0.325 - 1;
-
-  if (CS > 31)
-    CS = 31;
+  const uint8_t steps = TMC_RMS_n::find_steps(csTable, mA); // CS + 1
+  const uint8_t CS = steps > 0 ? steps - 1 : 0;
 
   typename T::IHOLD_IRUN_t r{ self().IHOLD_IRUN() };
   r.irun = CS;
-  r.ihold = CS*hold_multiplier();
+  r.ihold = TMC_RMS_n::hold_scale(CS, holdMultiplier);
   self().IHOLD_IRUN(r.sr);
 }
 
@@ -101,54 +95,39 @@ uint8_t TMCStepper<TYPE>::test_connection() {
   GLOBALSCALER = ------------------------------------    |
                            (CS + 1) * V_fs               | V_fs = 0.325
 
+  GLOBALSCALER keeps its full resolution from 128 up, so CS is the largest
+  one that leaves it there. It's found directly instead of trying each CS.
 */
 
 template<class T>
 void TMC2160_n::TMC_RMS<T>::rms_current(const uint16_t mA) {
-  const float rs = Rsense/255.0;
   constexpr uint32_t V_fs = 325; // 0.325 * 1000
-  uint8_t CS = 31;
-  uint32_t scaler = 0; // = 256
-
-  const uint16_t RS_scaled = rs * 0xFFFF; // Scale to 16b
-  uint32_t numerator = 11585; // 32 * 256 * sqrt(2)
-  numerator *= RS_scaled;
-  numerator >>= 8;
-  numerator *= mA;
-
-  do {
-    uint32_t denominator = V_fs * 0xFFFF >> 8;
-    denominator *= CS+1;
-    scaler = numerator / denominator;
-
-    if (scaler > 255) scaler = 0; // Maximum
-    else if (scaler < 128) CS--;  // Try again with smaller CS
-  } while(0 < scaler && scaler < 128);
-
+  constexpr uint32_t denominator = V_fs * 0xFFFF >> 8;
+  const uint32_t numerator = scaledRsense * mA;
 
-  if (CS > 31)
-    CS = 31;
+  const uint32_t steps = numerator / (128 * denominator); // CS + 1 at GLOBALSCALER = 128
+  const uint8_t CS = steps >= 32 ? 31 : steps > 0 ? steps - 1 : 0;
+  uint32_t scaler = numerator / (denominator * (CS+1));
+  if (scaler > 255) scaler = 0; // Maximum, = 256
+  else if (scaler < 32) scaler = 32; // Smallest allowed value
 
   typename T::IHOLD_IRUN_t r{ self().IHOLD_IRUN() };
   r.irun = CS;
-  r.ihold = CS*hold_multiplier();
+  r.ihold = TMC_RMS_n::hold_scale(CS, holdMultiplier);
   self().IHOLD_IRUN(r.sr);
   self().GLOBAL_SCALER(scaler);
 }
 
 template<class T>
 uint16_t TMC2160_n::TMC_RMS<T>::cs2rms(const uint8_t CS) {
-    const float rs = Rsense/255.0;
-    uint16_t scaler = self().GLOBAL_SCALER();
+    uint16_t scaler = self().GLOBAL_SCALER(); // write only, so this is the cached value
     if (!scaler) scaler = 256;
     uint32_t numerator = scaler * (CS+1);
     numerator *= 325;
     numerator >>= (8+5); // Divide by 256 and 32
     numerator *= 1000000;
-    uint32_t denominator = rs*1000;
-    denominator *= 1414;
 
-    return numerator / denominator;
+    return numerator / rmsDenominator;
 }
 
 template<typename TYPE>
@@ -0,0 +1,248 @@
+#include "arm.h"
+
+const unsigned long firstRetryDelay = 2000;  // ms
+const unsigned long maxRetryDelay = 60000;  // ms
+
+Arm::Arm(StepperMotor* joints[], int count, unsigned long pollInterval) :
+  count(count > maxJoints ? maxJoints : count),
+  pollInterval(pollInterval)
+{
+  for (int index = 0; index < this->count; index++) {
+    this->joints[index] = joints[index];
+    retrying[index] = false;
+  }
+}
+
+int Arm::size() {
+  return count;
+}
+
+StepperMotor& Arm::joint(int index) {
+  return *joints[index];
+}
+
+// Brings up every joint at once, sharing one reset wait. Use startSetup()
+// and updateSetup() instead to keep loop() running in the meantime.
+void Arm::setup() {
+  startSetup();
+  while (!updateSetup());
+}
+
+void Arm::startSetup() {
+  for (int index = 0; index < count; index++) {
+    joints[index]->presetup();  // every chip select high before the bus is used
+  }
+  for (int index = 0; index < count; index++) {
+    joints[index]->start_reset();
+  }
+  resetStart = millis();
+  stage = SetupStage::resetting;
+}
+
+// Call from loop() after startSetup(). Moves all the joints through one
+// stage per call and returns true once every joint is configured.
+bool Arm::updateSetup() {
+  switch (stage) {
+    case SetupStage::idle:
+      return false;
+    case SetupStage::resetting:
+      if (millis() - resetStart < resetDelay) return false;
+      for (int index = 0; index < count; index++) {
+        joints[index]->end_reset();
+      }
+      stage = SetupStage::verifying;
+      return false;
+    case SetupStage::verifying:
+      for (int index = 0; index < count; index++) {
+        if (joints[index]->check_driver() != DriverStatus::ok) schedule_retry(index, firstRetryDelay);
+      }
+      stage = SetupStage::configuring;
+      return false;
+    case SetupStage::configuring:
+      for (int index = 0; index < count; index++) {
+        if (joints[index]->isOnline()) joints[index]->configure();
+      }
+      stage = SetupStage::ready;
+      printReport();
+      return true;
+    case SetupStage::ready:
+      return true;
+  }
+  return false;
+}
+
+SetupStage Arm::setupStage() {
+  return stage;
+}
+
+int Arm::onlineCount() {
+  int online = 0;
+  for (int index = 0; index < count; index++) {
+    if (joints[index]->isOnline()) online++;
+  }
+  return online;
+}
+
+void Arm::printReport() {
+  Serial.print("Arm: ");
+  Serial.print(onlineCount());
+  Serial.print(" of ");
+  Serial.print(count);
+  Serial.println(" joints online");
+  for (int index = 0; index < count; index++) {
+    Serial.print("  ");
+    Serial.print(joints[index]->config.name);
+    Serial.print(": ");
+    Serial.println(describeStatus(joints[index]->status()));
+  }
+}
+
+void Arm::schedule_retry(int index, unsigned long delay) {
+  retrying[index] = false;
+  retryDelay[index] = delay;
+  retryAt[index] = millis() + delay;
+}
+
+// Failed joints are reset and checked again in the background, waiting
+// twice as long after every failure. The working joints are never paused.
+void Arm::retry_failed() {
+  unsigned long now = millis();
+  for (int index = 0; index < count; index++) {
+    StepperMotor& motor = *joints[index];
+    if (motor.isOnline() || (long) (now - retryAt[index]) < 0) continue;
+    if (!retrying[index]) {
+      motor.start_reset();
+      retrying[index] = true;
+      retryAt[index] = now + resetDelay;
+      continue;
+    }
+
+    motor.end_reset();
+    if (motor.check_driver() == DriverStatus::ok) {
+      retrying[index] = false;
+      motor.configure();
+      continue;
+    }
+    unsigned long delay = retryDelay[index] * 2;
+    schedule_retry(index, delay > maxRetryDelay ? maxRetryDelay : delay);
+  }
+}
+
+// Call from loop(). Refreshes every joint once per pollInterval, and
+// retries any joint that failed to come up.
+bool Arm::poll() {
+  if (stage == SetupStage::ready) retry_failed();
+  unsigned long now = millis();
+  if (now - lastPoll < pollInterval) return false;
+  lastPoll = now;
+  refresh();
+  return true;
+}
+
+void Arm::refresh() {
+  for (int index = 0; index < count; index++) {
+    joints[index]->refresh();
+  }
+  refreshes++;
+}
+
+// Copies the cached state of every joint, all from the same refresh, since
+// refresh() runs on the same thread. Returns the number of completed
+// refreshes so callers can spot new data.
+uint32_t Arm::snapshot(MotionState states[]) {
+  for (int index = 0; index < count; index++) {
+    states[index] = joints[index]->motionState();
+  }
+  return refreshes;
+}
+
+// Moves every joint so they all start and arrive at the same time. Returns
+// false without moving anything if a position is out of bounds.
+bool Arm::moveTogether(const double positions[]) {
+  int32_t targets[maxJoints];  // int is only 16 bits on AVR
+  for (int index = 0; index < count; index++) {
+    StepperMotor& motor = *joints[index];
+    if (!motor.limitSwitch.isValid(positions[index])) return false;
+    targets[index] = positions[index] * motor.config.stepsPerUnit;
+  }
+  moveTogetherSteps(targets);
+  return true;
+}
+
+static void tighten(double& limit, uint32_t value, double distance) {
+  double ratio = value / distance;
+  if (ratio < limit) limit = ratio;
+}
+
+static uint32_t scaled(double limit, double distance, uint32_t minimum) {
+  uint32_t value = limit * distance;
+  return value < minimum ? minimum : value;
+}
+
+// Every joint gets the same ramp shape, scaled by its own distance. Using the
+// tightest limit per unit of distance keeps each joint within its own limits
+// and makes the path a straight line in joint space.
+void Arm::moveTogetherSteps(const int32_t targets[]) {
+  int32_t driverTargets[maxJoints];
+  double distances[maxJoints];
+  double vstart = INFINITY, a1 = INFINITY, v1 = INFINITY, amax = INFINITY;
+  double vmax = INFINITY, dmax = INFINITY, d1 = INFINITY, vstop = INFINITY;
+
+  for (int index = 0; index < count; index++) {
+    StepperMotor& motor = *joints[index];
+    driverTargets[index] = motor.to_driver_steps(targets[index]);
+    int32_t distance = motor.isOnline() ? driverTargets[index] - (int32_t) motor.driver.XACTUAL() : 0;
+    distances[index] = distance < 0 ? -distance : distance;
+    if (distance == 0) continue;
+
+    RampParameters ramp = motor.defaultRamp();
+    tighten(vstart, ramp.vstart, distances[index]);
+    tighten(a1, ramp.a1, distances[index]);
+    tighten(v1, ramp.v1, distances[index]);
+    tighten(amax, ramp.amax, distances[index]);
+    tighten(vmax, ramp.vmax, distances[index]);
+    tighten(dmax, ramp.dmax, distances[index]);
+    tighten(d1, ramp.d1, distances[index]);
+    tighten(vstop, ramp.vstop, distances[index]);
+  }
+
+  // Stage every ramp first so the targets can go out back to back
+  for (int index = 0; index < count; index++) {
+    StepperMotor& motor = *joints[index];
+    if (distances[index] == 0) {
+      motor.setRamp(motor.defaultRamp());
+      continue;
+    }
+
+    RampParameters ramp;
+    ramp.vstart = scaled(vstart, distances[index], 0);
+    ramp.a1 = scaled(a1, distances[index], 1);
+    ramp.v1 = scaled(v1, distances[index], 0);
+    ramp.amax = scaled(amax, distances[index], 1);
+    ramp.vmax = scaled(vmax, distances[index], 1);
+    ramp.dmax = scaled(dmax, distances[index], 1);
+    ramp.d1 = scaled(d1, distances[index], 1);
+    ramp.vstop = scaled(vstop, distances[index], ramp.vstart > 1 ? ramp.vstart : 1);
+    motor.setRamp(ramp);
+  }
+
+  for (int index = 0; index < count; index++) {
+    joints[index]->write_target(driverTargets[index]);
+  }
+}
+
+// Holds moveTo() and the other single joint moves until flush(). Moving
+// together still goes out at once, and replaces anything pending.
+void Arm::deferMoves(bool enable) {
+  for (int index = 0; index < count; index++) {
+    joints[index]->deferMoves(enable);
+  }
+}
+
+// Call once per loop. Writes the latest target of every joint that got a
+// new one, back to back.
+void Arm::flush() {
+  for (int index = 0; index < count; index++) {
+    joints[index]->flush();
+  }
+}
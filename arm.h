@@ -0,0 +1,45 @@
+#pragma once
+#include "BURT_TMC.h"
+
+const int maxJoints = 8;
+
+enum class SetupStage { idle, resetting, verifying, configuring, ready };
+
+class Arm {
+  private:
+    StepperMotor* joints[maxJoints];
+    int count;
+    unsigned long pollInterval;  // ms
+    unsigned long lastPoll = 0;
+    uint32_t refreshes = 0;
+    SetupStage stage = SetupStage::idle;
+    unsigned long resetStart = 0;
+    unsigned long retryAt[maxJoints];
+    unsigned long retryDelay[maxJoints];
+    bool retrying[maxJoints];  // waiting out the reset of a retry
+
+    void schedule_retry(int index, unsigned long delay);
+    void retry_failed();
+
+  public:
+    Arm(StepperMotor* joints[], int count, unsigned long pollInterval = 10);
+
+    int size();
+    StepperMotor& joint(int index);
+
+    void setup();
+    void startSetup();
+    bool updateSetup();
+    SetupStage setupStage();
+    int onlineCount();
+    void printReport();
+
+    bool poll();
+    void refresh();
+    uint32_t snapshot(MotionState states[]);
+
+    bool moveTogether(const double positions[]);
+    void moveTogetherSteps(const int32_t targets[]);
+    void deferMoves(bool enable);
+    void flush();
+};
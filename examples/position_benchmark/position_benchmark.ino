@@ -0,0 +1,57 @@
+// Times the conversions in position.h against the double math they replace,
+// in CPU cycles per conversion. Upload it and open the serial monitor at
+// 9600 baud. Each figure includes its loop, so compare them with each other.
+#include <position.h>
+
+using JointAngle = FixedPosition<51200 * 50, 360>;  // 50:1 gearbox, in degrees
+const double stepsPerDegree = 51200 * 50 / 360.0;
+const int conversions = 1000;
+
+// Read on every pass, so the compiler can't fold the conversions away
+volatile int32_t input = 123456;
+volatile int32_t stepsSink;
+volatile q16 unitsSink;
+volatile double doubleSink;
+
+void report(const char* name, unsigned long start) {
+  unsigned long elapsed = micros() - start;
+  Serial.print(name);
+  Serial.print(": ");
+  Serial.print(elapsed * (F_CPU / 1000000) / conversions);
+  Serial.println(" cycles");
+}
+
+void setup() {
+  Serial.begin(9600);
+
+  unsigned long start = micros();
+  for (int i = 0; i < conversions; i++) {
+    int32_t steps = 0;
+    JointAngle(input + i).toSteps(steps);
+    stepsSink = steps;
+  }
+  report("FixedPosition::toSteps", start);
+
+  start = micros();
+  for (int i = 0; i < conversions; i++) {
+    JointAngle position;
+    JointAngle::fromSteps(input + i, position);
+    unitsSink = position.value;
+  }
+  report("FixedPosition::fromSteps", start);
+
+  start = micros();
+  for (int i = 0; i < conversions; i++) {
+    double degrees = (input + i) / 65536.0;
+    stepsSink = degrees * stepsPerDegree + 0.5;
+  }
+  report("double to steps", start);
+
+  start = micros();
+  for (int i = 0; i < conversions; i++) {
+    doubleSink = (input + i) / stepsPerDegree;
+  }
+  report("double from steps", start);
+}
+
+void loop() { }
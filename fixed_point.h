@@ -0,0 +1,9 @@
+#pragma once
+#include <stdint.h>
+
+// Q16.16 fixed point, for boards without an FPU
+using q16 = int32_t;
+const q16 q16One = 65536;
+
+constexpr q16 toQ16(double value) { return value * q16One + (value < 0 ? -0.5 : 0.5); }
+inline double fromQ16(q16 value) { return value / (double) q16One; }
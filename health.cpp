@@ -0,0 +1,137 @@
+#include "health.h"
+
+const int drvStatusRegister = 0;
+const int gstatRegister = 1;
+const int ioinRegister = 2;
+const int healthRegisters = 3;
+const uint8_t recoveryReads = 3;  // clean reads before a state improves
+
+HealthMonitor::HealthMonitor(Arm& arm, double budget) :
+  arm(arm),
+  budget(budget)
+  { }
+
+const MotorHealth& HealthMonitor::motorHealth(int joint) {
+  return health[joint];
+}
+
+void HealthMonitor::onChange(HealthCallback callback) {
+  this->callback = callback;
+}
+
+// Call from loop(). Does at most one read, and only once enough bus time
+// has been earned, so it never holds up the motion code for long.
+void HealthMonitor::update() {
+  unsigned long now = micros();
+  credit += (now - lastUpdate) * budget;
+  lastUpdate = now;
+  if (credit > 4 * readCost) credit = 4 * readCost;  // no burst after a long gap
+  if (credit < readCost) return;
+
+  int joint, reg;
+  if (!pick_urgent(joint, reg) && !pick_next(joint, reg)) return;
+  unsigned long start = micros();
+  read_register(joint, reg);
+  readCost = micros() - start;
+  credit -= readCost;
+}
+
+// The status byte of the last transfer flags errors and resets that the
+// monitor hasn't looked at yet. A driver error reads DRV_STATUS to see what
+// went wrong, then GSTAT, which records it. drv_err can stay latched with a
+// clean DRV_STATUS, so after that it waits for the round robin like the rest.
+bool HealthMonitor::pick_urgent(int& joint, int& reg) {
+  for (int index = 0; index < arm.size(); index++) {
+    StepperMotor& motor = arm.joint(index);
+    if (!motor.isOnline()) continue;
+    TMC5160Stepper::SPI_STATUS_t status { motor.driver.spi_status() };
+    if (status.driver_error && !(health[index].gstatFaults & faultDriverError)) {
+      joint = index;
+      reg = drvStatusRead[index] ? gstatRegister : drvStatusRegister;
+      return true;
+    }
+    if (status.reset_flag && !(health[index].gstatFaults & faultReset)) {
+      joint = index;
+      reg = gstatRegister;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Goes through one register on every joint before moving to the next
+// register, so back to back reads land on different drivers
+bool HealthMonitor::pick_next(int& joint, int& reg) {
+  for (int tries = 0; tries < arm.size(); tries++) {
+    joint = nextJoint;
+    reg = nextRegister;
+    nextJoint = (nextJoint + 1) % arm.size();
+    if (nextJoint == 0) nextRegister = (nextRegister + 1) % healthRegisters;
+    if (arm.joint(joint).isOnline()) return true;
+  }
+  return false;
+}
+
+void HealthMonitor::read_register(int joint, int reg) {
+  StepperMotor& motor = arm.joint(joint);
+  MotorHealth& motorHealth = health[joint];
+  uint16_t faults = 0;
+  motorHealth.timestamp = millis();
+
+  if (reg == drvStatusRegister) {
+    TMC5160Stepper::DRV_STATUS_t status { 0 };
+    status.sr = motor.driver.DRV_STATUS();
+    motorHealth.drvStatus = status.sr;
+    motor.state.drvStatus = status.sr;
+    drvStatusRead[joint] = true;
+    if (status.ot) faults |= faultOvertemperature;
+    if (status.otpw) faults |= faultOvertempWarning;
+    if (status.s2ga || status.s2gb) faults |= faultShortToGround;
+    if (status.s2vsa || status.s2vsb) faults |= faultShortToSupply;
+    if (status.ola || status.olb) faults |= faultOpenLoad;
+    apply(joint, motorHealth.drvFaults, faults);
+  } else if (reg == gstatRegister) {
+    TMC5160Stepper::GSTAT_t status { motor.driver.GSTAT() };
+    motorHealth.gstat = status.sr;
+    drvStatusRead[joint] = false;
+    if (status.drv_err) faults |= faultDriverError;
+    if (status.uv_cp) faults |= faultUndervoltage;
+    if (status.reset) faults |= faultReset;
+    // The flags stay set until cleared. The motor clears them itself after
+    // restoring its registers from a reset.
+    if (status.reset) motor.recover_from_reset();
+    else if (status.sr) motor.driver.GSTAT(7);
+    apply(joint, motorHealth.gstatFaults, faults);
+  } else {
+    TMC5160Stepper::IOIN_t ioin { 0 };
+    ioin.sr = motor.driver.IOIN();
+    motorHealth.ioin = ioin.sr;
+    if (ioin.version == 0xFF || ioin.version == 0) faults |= faultNoResponse;
+    else if (ioin.drv_enn) faults |= faultNotEnabled;
+    apply(joint, motorHealth.ioinFaults, faults);
+  }
+}
+
+static HealthState severity(uint16_t faults) {
+  if (faults & faultNoResponse) return HealthState::offline;
+  if (faults & ~warningFaults) return HealthState::fault;
+  if (faults) return HealthState::warning;
+  return HealthState::ok;
+}
+
+// Bad news is taken at once, but a joint only recovers after a few clean
+// reads in a row, so a flickering flag doesn't flood the callback.
+void HealthMonitor::apply(int joint, uint16_t& source, uint16_t faults) {
+  MotorHealth& motorHealth = health[joint];
+  source = faults;
+  uint16_t combined = motorHealth.drvFaults | motorHealth.gstatFaults | motorHealth.ioinFaults;
+  HealthState next = severity(combined);
+  if (next < motorHealth.state && ++motorHealth.cleanReads < recoveryReads) return;
+  motorHealth.cleanReads = 0;
+  if (combined == motorHealth.faults && next == motorHealth.state) return;
+
+  motorHealth.previousFaults = motorHealth.faults;
+  motorHealth.faults = combined;
+  motorHealth.state = next;
+  if (callback != nullptr) callback(arm.joint(joint), motorHealth);
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "arm.h"
+
+// Fault bits, from DRV_STATUS, GSTAT and IOIN
+const uint16_t faultOvertemperature = 1 << 0;   // ot
+const uint16_t faultOvertempWarning = 1 << 1;   // otpw
+const uint16_t faultShortToGround = 1 << 2;     // s2ga or s2gb
+const uint16_t faultShortToSupply = 1 << 3;     // s2vsa or s2vsb
+const uint16_t faultOpenLoad = 1 << 4;          // ola or olb
+const uint16_t faultDriverError = 1 << 5;       // GSTAT.drv_err
+const uint16_t faultUndervoltage = 1 << 6;      // GSTAT.uv_cp
+const uint16_t faultReset = 1 << 7;             // GSTAT.reset
+const uint16_t faultNotEnabled = 1 << 8;        // IOIN.drv_enn
+const uint16_t faultNoResponse = 1 << 9;        // IOIN.version
+
+const uint16_t warningFaults = faultOvertempWarning | faultOpenLoad | faultReset;
+
+enum class HealthState { ok, warning, fault, offline };
+
+struct MotorHealth {
+  HealthState state = HealthState::ok;
+  uint16_t faults = 0;
+  uint16_t previousFaults = 0;  // before the last change
+  uint32_t drvStatus = 0;
+  uint8_t gstat = 0;
+  uint32_t ioin = 0;
+  unsigned long timestamp = 0;  // ms of the last read
+
+  // Faults by source, so one register doesn't clear another's bits
+  uint16_t drvFaults = 0;
+  uint16_t gstatFaults = 0;
+  uint16_t ioinFaults = 0;
+  uint8_t cleanReads = 0;
+};
+
+using HealthCallback = void (*)(StepperMotor& motor, const MotorHealth& health);
+
+// Reads DRV_STATUS, GSTAT and IOIN from every joint in turn, one register
+// per update(), while keeping those reads under a share of the bus time.
+// Joints whose SPI status byte already shows an error or a reset jump the
+// queue, since that byte comes for free with every motion read.
+class HealthMonitor {
+  private:
+    Arm& arm;
+    double budget;  // fraction of the time the bus may spend on health reads
+    MotorHealth health[maxJoints];
+    bool drvStatusRead[maxJoints] = {};  // since the last GSTAT read
+    HealthCallback callback = nullptr;
+
+    int nextJoint = 0;
+    int nextRegister = 0;
+    double credit = 0;  // µs of bus time earned
+    unsigned long lastUpdate = 0;  // µs
+    unsigned long readCost = 100;  // µs, measured on every read
+
+    bool pick_urgent(int& joint, int& reg);
+    bool pick_next(int& joint, int& reg);
+    void read_register(int joint, int reg);
+    void apply(int joint, uint16_t& source, uint16_t faults);
+
+  public:
+    HealthMonitor(Arm& arm, double budget = 0.05);
+
+    void update();
+    const MotorHealth& motorHealth(int joint);
+    void onChange(HealthCallback callback);
+};
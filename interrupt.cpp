@@ -0,0 +1,45 @@
+#include "interrupt.h"
+
+struct InterruptSlot {
+  int pin = -1;
+  InterruptHandler handler = nullptr;
+  void* context = nullptr;
+};
+
+static InterruptSlot slots[maxInterruptHandlers];
+
+template<int index>
+static void dispatch() {
+  slots[index].handler(slots[index].context);
+}
+
+static void (* const dispatchers[maxInterruptHandlers])() = {
+  dispatch<0>, dispatch<1>, dispatch<2>, dispatch<3>,
+  dispatch<4>, dispatch<5>, dispatch<6>, dispatch<7>,
+};
+
+// False if the pin has no interrupt, or the table is full
+bool attachContextInterrupt(int pin, InterruptHandler handler, void* context, int mode) {
+  detachContextInterrupt(pin);
+#ifdef NOT_AN_INTERRUPT
+  if (digitalPinToInterrupt(pin) == NOT_AN_INTERRUPT) return false;
+#endif
+  for (int index = 0; index < maxInterruptHandlers; index++) {
+    InterruptSlot& slot = slots[index];
+    if (slot.pin != -1) continue;
+    slot.handler = handler;
+    slot.context = context;
+    slot.pin = pin;
+    attachInterrupt(digitalPinToInterrupt(pin), dispatchers[index], mode);
+    return true;
+  }
+  return false;
+}
+
+void detachContextInterrupt(int pin) {
+  for (InterruptSlot& slot : slots) {
+    if (slot.pin != pin) continue;
+    detachInterrupt(digitalPinToInterrupt(pin));
+    slot.pin = -1;
+  }
+}
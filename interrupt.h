@@ -0,0 +1,11 @@
+#pragma once
+#include <Arduino.h>
+
+using InterruptHandler = void (*)(void* context);
+
+// attachInterrupt() only takes plain functions, so handlers are kept in a
+// small table and each one is called with the object it was attached for.
+const int maxInterruptHandlers = 8;
+
+bool attachContextInterrupt(int pin, InterruptHandler handler, void* context, int mode);
+void detachContextInterrupt(int pin);
@@ -0,0 +1,131 @@
+#include "kinematics.h"
+#include <math.h>
+
+bool inverseKinematics(const ArmGeometry<float>& geometry, const GripperPose<float>& pose, JointAngles<float>& joints) {
+  // Work in the vertical plane the arm is swivelled into
+  float reach = sqrtf(pose.x * pose.x + pose.y * pose.y);
+  float wristReach = reach - geometry.gripperLength * cosf(pose.pitch);
+  float wristHeight = pose.z - geometry.gripperLength * sinf(pose.pitch) - geometry.shoulderHeight;
+  float boom = sqrtf(wristReach * wristReach + wristHeight * wristHeight);
+
+  joints.swivel = atan2f(pose.y, pose.x);
+  joints.lift = atan2f(wristHeight, wristReach);
+  joints.extend = boom - geometry.minExtension;
+  joints.gripperLift = pose.pitch - joints.lift;
+  return boom >= geometry.minExtension && boom <= geometry.maxExtension;
+}
+
+GripperPose<float> forwardKinematics(const ArmGeometry<float>& geometry, const JointAngles<float>& joints) {
+  float boom = geometry.minExtension + joints.extend;
+  float pitch = joints.lift + joints.gripperLift;
+  float reach = boom * cosf(joints.lift) + geometry.gripperLength * cosf(pitch);
+
+  GripperPose<float> pose;
+  pose.x = reach * cosf(joints.swivel);
+  pose.y = reach * sinf(joints.swivel);
+  pose.z = geometry.shoulderHeight + boom * sinf(joints.lift) + geometry.gripperLength * sinf(pitch);
+  pose.pitch = pitch;
+  return pose;
+}
+
+// CORDIC, 16 iterations for 16 fractional bits
+const int cordicSteps = 16;
+const q16 cordicAngles[cordicSteps] = {  // atan(2^-i)
+  51472, 30386, 16055, 8150, 4091, 2047, 1024, 512,
+  256, 128, 64, 32, 16, 8, 4, 2,
+};
+const q16 cordicGain = 39797;  // 1 / prod(sqrt(1 + 2^-2i))
+const q16 q16Pi = 205887;
+const q16 q16HalfPi = 102944;
+
+static q16 multiply(q16 a, q16 b) {
+  return ((int64_t) a * b) >> 16;
+}
+
+// Vectoring mode: atan2(y, x) and the length of (x, y) in one pass
+static void cordic_polar(q16 x, q16 y, q16& angle, q16& length) {
+  angle = 0;
+  if (x < 0) {
+    angle = y < 0 ? -q16Pi : q16Pi;
+    x = -x;
+    y = -y;
+  }
+  for (int i = 0; i < cordicSteps; i++) {
+    q16 dx = y >> i;
+    q16 dy = x >> i;
+    if (y > 0) {
+      x += dx;
+      y -= dy;
+      angle += cordicAngles[i];
+    } else {
+      x -= dx;
+      y += dy;
+      angle -= cordicAngles[i];
+    }
+  }
+  if (angle > q16Pi) angle -= 2 * q16Pi;
+  if (angle < -q16Pi) angle += 2 * q16Pi;
+  length = multiply(x, cordicGain);
+}
+
+// Rotation mode: cos and sin of an angle
+static void cordic_rotate(q16 angle, q16& cosine, q16& sine) {
+  while (angle > q16Pi) angle -= 2 * q16Pi;
+  while (angle < -q16Pi) angle += 2 * q16Pi;
+
+  bool flip = false;
+  if (angle > q16HalfPi) {
+    angle -= q16Pi;
+    flip = true;
+  } else if (angle < -q16HalfPi) {
+    angle += q16Pi;
+    flip = true;
+  }
+  q16 x = cordicGain, y = 0;
+  for (int i = 0; i < cordicSteps; i++) {
+    q16 dx = y >> i;
+    q16 dy = x >> i;
+    if (angle >= 0) {
+      x -= dx;
+      y += dy;
+      angle -= cordicAngles[i];
+    } else {
+      x += dx;
+      y -= dy;
+      angle += cordicAngles[i];
+    }
+  }
+  cosine = flip ? -x : x;
+  sine = flip ? -y : y;
+}
+
+bool inverseKinematics(const ArmGeometry<q16>& geometry, const GripperPose<q16>& pose, JointAngles<q16>& joints) {
+  q16 reach, pitchCos, pitchSin, boom;
+  cordic_polar(pose.x, pose.y, joints.swivel, reach);
+  cordic_rotate(pose.pitch, pitchCos, pitchSin);
+
+  q16 wristReach = reach - multiply(geometry.gripperLength, pitchCos);
+  q16 wristHeight = pose.z - multiply(geometry.gripperLength, pitchSin) - geometry.shoulderHeight;
+  cordic_polar(wristReach, wristHeight, joints.lift, boom);
+
+  joints.extend = boom - geometry.minExtension;
+  joints.gripperLift = pose.pitch - joints.lift;
+  return boom >= geometry.minExtension && boom <= geometry.maxExtension;
+}
+
+GripperPose<q16> forwardKinematics(const ArmGeometry<q16>& geometry, const JointAngles<q16>& joints) {
+  q16 liftCos, liftSin, pitchCos, pitchSin, swivelCos, swivelSin;
+  q16 boom = geometry.minExtension + joints.extend;
+  q16 pitch = joints.lift + joints.gripperLift;
+  cordic_rotate(joints.lift, liftCos, liftSin);
+  cordic_rotate(pitch, pitchCos, pitchSin);
+  cordic_rotate(joints.swivel, swivelCos, swivelSin);
+  q16 reach = multiply(boom, liftCos) + multiply(geometry.gripperLength, pitchCos);
+
+  GripperPose<q16> pose;
+  pose.x = multiply(reach, swivelCos);
+  pose.y = multiply(reach, swivelSin);
+  pose.z = geometry.shoulderHeight + multiply(boom, liftSin) + multiply(geometry.gripperLength, pitchSin);
+  pose.pitch = pitch;
+  return pose;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <stdint.h>
+#include "fixed_point.h"
+
+// Lengths are in whatever unit the extend joint uses, angles in radians.
+// The swivel turns about the vertical axis, the lift pitches the boom about a
+// pivot shoulderHeight above the base, the extend joint slides the boom out
+// from minExtension, and the gripper lift pitches the gripper at the end of
+// the boom.
+template<typename Number>
+struct ArmGeometry {
+  Number shoulderHeight;
+  Number minExtension;
+  Number maxExtension;
+  Number gripperLength;
+};
+
+// The position of the gripper tip, and its pitch from horizontal
+template<typename Number>
+struct GripperPose {
+  Number x;
+  Number y;
+  Number z;
+  Number pitch;
+};
+
+// Joint targets, ready to pass to StepperMotor::moveTo()
+template<typename Number>
+struct JointAngles {
+  Number swivel;
+  Number lift;
+  Number extend;  // travel beyond minExtension
+  Number gripperLift;
+};
+
+// Both solve in a fixed number of steps without allocating, and return
+// false if the pose is out of the extend joint's reach.
+bool inverseKinematics(const ArmGeometry<float>& geometry, const GripperPose<float>& pose, JointAngles<float>& joints);
+bool inverseKinematics(const ArmGeometry<q16>& geometry, const GripperPose<q16>& pose, JointAngles<q16>& joints);
+
+GripperPose<float> forwardKinematics(const ArmGeometry<float>& geometry, const JointAngles<float>& joints);
+GripperPose<q16> forwardKinematics(const ArmGeometry<q16>& geometry, const JointAngles<q16>& joints);
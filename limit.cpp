@@ -1,7 +1,8 @@
 #include "limit.h"
 
 bool LimitSwitch::isPressed() {
-  return isAttached() && digitalRead(pin) == triggeredValue;
+  if (isInterruptAttached) return pressed;
+  return pin != -1 && digitalRead(pin) == triggeredValue;
 }
 
 bool LimitSwitch::isValid(double position) {
@@ -9,5 +10,57 @@ bool LimitSwitch::isValid(double position) {
 }
 
 bool LimitSwitch::isAttached() {
-  return pin != -1;
+  return pin != -1 || isHardware || isSensorless;
+}
+
+// Starts watching the pin if useInterrupt is set and the pin has an
+// interrupt. `handler` is called from the interrupt whenever the switch
+// is pressed, so it should only set a flag.
+bool LimitSwitch::attach(InterruptHandler handler, void* context) {
+  if (pin == -1 || !useInterrupt) return false;
+  pressHandler = handler;
+  pressContext = context;
+  pressed = digitalRead(pin) == triggeredValue;
+  lastEdge = micros() - debounceTime;
+  isInterruptAttached = attachContextInterrupt(pin, on_change, this, CHANGE);
+  return isInterruptAttached;
+}
+
+// Debounces on the leading edge: the first change is taken at once and
+// anything else within debounceTime is bounce.
+void LimitSwitch::on_change(void* context) {
+  LimitSwitch& limit = *static_cast<LimitSwitch*>(context);
+  unsigned long now = micros();
+  bool value = digitalRead(limit.pin) == limit.triggeredValue;
+  if (value == limit.pressed || now - limit.lastEdge < limit.debounceTime) return;
+  limit.lastEdge = now;
+  limit.pressed = value;
+  limit.edges = limit.edges + 1;
+  if (value && limit.pressHandler != nullptr) limit.pressHandler(limit.pressContext);
+}
+
+// A bounce can settle in the other state after its edges were ignored, with
+// no edge left to report it. Call this now and then to pick that up.
+void LimitSwitch::poll() {
+  if (!isInterruptAttached || micros() - edgeTime() < debounceTime) return;
+  if ((digitalRead(pin) == triggeredValue) == pressed) return;
+  noInterrupts();
+  on_change(this);
+  interrupts();
+}
+
+// µs of the last debounced edge. An edge can land halfway through reading
+// it, so read until the edge count doesn't change.
+unsigned long LimitSwitch::edgeTime() {
+  uint8_t before;
+  unsigned long time;
+  do {
+    before = edges;
+    time = lastEdge;
+  } while (before != edges);
+  return time;
+}
+
+uint8_t LimitSwitch::edgeCount() {
+  return edges;
 }
@@ -1,11 +1,19 @@
+#pragma once
 #include <Arduino.h>
+#include "interrupt.h"
 
 struct LimitSwitch {
   int pin = -1;
   int triggeredValue;
   int direction = 1;
   bool isBlocking = true;
-  double position;
+  bool isHardware = false;  // wired to the driver's REFL/REFR input
+  bool softStop = false;    // ramp down with DMAX instead of stopping hard
+  bool isSensorless = false;  // home against a hard stop with StallGuard
+  int stallThreshold = 0;     // COOLCONF.sgt, see StepperMotor::tuneStallGuard()
+  bool useInterrupt = false;  // watch the pin with an interrupt instead of reading it
+  unsigned long debounceTime = 2000;  // µs after an edge in which the pin is ignored
+  double position = 0;
   double minLimit = -INFINITY;
   double maxLimit = INFINITY;
 
@@ -13,4 +21,19 @@ struct LimitSwitch {
   bool isPressed();
   bool isValid(double position);
   bool isAttached();
+
+  bool attach(InterruptHandler handler = nullptr, void* context = nullptr);
+  void poll();
+  unsigned long edgeTime();
+  uint8_t edgeCount();
+
+  // Kept by the interrupt. The main code only reads them.
+  volatile bool pressed = false;
+  volatile uint8_t edges = 0;  // debounced edges so far
+  volatile unsigned long lastEdge = 0;  // µs
+  bool isInterruptAttached = false;
+  InterruptHandler pressHandler = nullptr;
+  void* pressContext = nullptr;
+
+  static void on_change(void* context);
 };
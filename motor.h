@@ -0,0 +1,350 @@
+#pragma once
+#include <Arduino.h>
+#include "TmcStepper.h"
+
+#include "units.h"
+#include "limit.h"
+#include "ramp.h"
+#include "step_generator.h"
+#include "velocity_controller.h"
+
+// The motion logic that doesn't depend on the chip, for subsystems that
+// don't use the TMC5160. A Motor is templated on a backend that moves the
+// motor, and each backend on the driver's class, so every call is resolved
+// at compile time with no virtual calls. The backends are:
+//
+//   RampBackend     TMC5130 and TMC5160, using the chip's own ramp generator
+//   StepDirBackend  any driver, stepped by a StepGenerator
+//   VactualBackend  TMC2208 and TMC2209, ramping VACTUAL over UART
+//
+// A Motor handles a limit switch on an MCU pin: its bounds, homing and
+// stopping a move into it. StepperMotor stays the full TMC5160 motor, with
+// switches on REFL/REFR, sensorless homing, encoders, jogging and StallGuard
+// tuning, since those use the chip's own registers. Each backend has:
+//
+//   bool begin(int current);
+//   void setLimits(Velocity maxVelocity, Acceleration acceleration);
+//   void moveTo(int32_t steps);
+//   int32_t position();
+//   bool isMoving();
+//   void stop();
+//   void update();
+//   Driver& driver();
+
+const float defaultRsense = 0.075;  // Ω
+const int32_t homingDistance = 1l << 30;  // steps, further than any switch
+const unsigned long motorHomingTimeout = 30000;  // ms
+
+// How to reach a driver. SPI chips use spi and chipSelect, UART chips use
+// serial and address. A plain aggregate, so it can be brace-initialized
+// under C++11; spiDriver() and uartDriver() fill in the rest.
+struct DriverConfig {
+  float rsense;  // Ω, the sense resistor on the driver board, 0 for 0.075
+  SPIClass* spi;  // nullptr for SPI
+  int chipSelect;
+  HardwareSerial* serial;
+  uint8_t address;  // set by MS1 and MS2 on the TMC2209
+};
+
+inline DriverConfig spiDriver(int chipSelect, float rsense = defaultRsense, SPIClass& spi = SPI) {
+  return DriverConfig { rsense, &spi, chipSelect, nullptr, 0 };
+}
+
+inline DriverConfig uartDriver(HardwareSerial& serial, uint8_t address = 0, float rsense = defaultRsense) {
+  return DriverConfig { rsense, nullptr, -1, &serial, address };
+}
+
+inline float driver_rsense(const DriverConfig& config) {
+  return config.rsense > 0 ? config.rsense : defaultRsense;
+}
+
+// Builds any supported driver from a DriverConfig
+template<class Driver>
+Driver makeDriver(const DriverConfig& config) {
+  return Driver(config.spi != nullptr ? *config.spi : SPI, config.chipSelect, driver_rsense(config));
+}
+
+template<>
+inline TMC2208Stepper makeDriver<TMC2208Stepper>(const DriverConfig& config) {
+  return TMC2208Stepper(*config.serial, driver_rsense(config));
+}
+
+template<>
+inline TMC2209Stepper makeDriver<TMC2209Stepper>(const DriverConfig& config) {
+  return TMC2209Stepper(*config.serial, driver_rsense(config), config.address);
+}
+
+template<>
+inline TMC2300Stepper makeDriver<TMC2300Stepper>(const DriverConfig& config) {
+  return TMC2300Stepper(*config.serial, driver_rsense(config), config.address);
+}
+
+// Moves with the chip's six point ramp, in positioning mode
+template<class Driver>
+class RampBackend {
+  private:
+    Driver chip;
+    ChipClock clock;
+    int32_t target = 0;
+
+  public:
+    RampBackend(const DriverConfig& config, double clockFrequency = driverClock) :
+      chip(makeDriver<Driver>(config)),
+      clock(clockFrequency)
+      { }
+
+    bool begin(int current) {
+      chip.begin();
+      chip.tbl(2);
+      chip.toff(9);
+      chip.rms_current(current);
+      chip.RAMPMODE(0);
+      return true;
+    }
+
+    void setLimits(Velocity maxVelocity, Acceleration acceleration) {
+      MotionLimits limits;
+      limits.maxVelocity = maxVelocity;
+      limits.maxAcceleration = acceleration;
+      limits.transitionVelocity = maxVelocity;  // a single stage ramp
+      RampParameters ramp = planRamp(limits, clock);
+      chip.a1(ramp.a1);
+      chip.v1(ramp.v1);
+      chip.AMAX(ramp.amax);
+      chip.VMAX(ramp.vmax);
+      chip.DMAX(ramp.dmax);
+      chip.d1(ramp.d1);
+      chip.vstop(ramp.vstop);
+      chip.vstart(ramp.vstart);
+    }
+
+    // An unchanged target costs no SPI traffic
+    void moveTo(int32_t steps) {
+      if (steps == target) return;
+      target = steps;
+      chip.XTARGET(steps);
+    }
+
+    int32_t position() { return chip.XACTUAL(); }
+    bool isMoving() { return !chip.position_reached(); }
+    void update() { }
+
+    void stop() {
+      target = chip.XACTUAL();
+      chip.XTARGET(target);
+    }
+
+    Driver& driver() { return chip; }
+};
+
+// Steps the driver from an axis of a StepGenerator. The driver's bus is
+// only used to set the current and double edge stepping.
+template<class Driver>
+class StepDirBackend {
+  private:
+    Driver chip;
+    StepGenerator& generator;
+    int axis;
+    bool hasPendingTarget = false;
+    int32_t pendingTarget = 0;
+
+  public:
+    StepDirBackend(const DriverConfig& config, StepGenerator& generator, StepDirPins pins) :
+      chip(makeDriver<Driver>(config)),
+      generator(generator),
+      axis(generator.addAxis(pins))
+      { }
+
+    // False if the generator has no axis left
+    bool begin(int current) {
+      chip.begin();
+      chip.rms_current(current);
+      chip.dedge(true);
+      return axis >= 0;
+    }
+
+    void setLimits(Velocity maxVelocity, Acceleration acceleration) {
+      generator.setLimits(axis, maxVelocity, acceleration);
+    }
+
+    // The generator can't turn around mid-move, so a target behind the axis
+    // waits in update() until it has slowed down and stopped
+    void moveTo(int32_t steps) {
+      hasPendingTarget = false;
+      if (generator.moveTo(axis, steps)) return;
+      generator.stop(axis);
+      hasPendingTarget = true;
+      pendingTarget = steps;
+    }
+
+    int32_t position() { return generator.position(axis); }
+    bool isMoving() { return hasPendingTarget || generator.isMoving(axis); }
+
+    void stop() {
+      hasPendingTarget = false;
+      generator.stop(axis);
+    }
+
+    void update() {
+      if (!hasPendingTarget || generator.isMoving(axis)) return;
+      hasPendingTarget = false;
+      generator.moveTo(axis, pendingTarget);
+    }
+
+    Driver& driver() { return chip; }
+};
+
+// Runs the driver's internal step generator with a VelocityController. The
+// controller keeps a reference to the driver, so this can't be copied.
+template<class Driver>
+class VactualBackend {
+  private:
+    Driver chip;
+    VelocityController<Driver> controller;
+
+  public:
+    VactualBackend(const DriverConfig& config, double clockFrequency = driverClock) :
+      chip(makeDriver<Driver>(config)),
+      controller(chip, clockFrequency)
+      { }
+    VactualBackend(const VactualBackend&) = delete;
+
+    bool begin(int current) {
+      chip.begin();
+      chip.rms_current(current);
+      return true;
+    }
+
+    void setLimits(Velocity maxVelocity, Acceleration acceleration) {
+      controller.setLimits(maxVelocity, acceleration);
+    }
+
+    void moveTo(int32_t steps) { controller.moveTo(steps); }
+    int32_t position() { return controller.position(); }
+    bool isMoving() { return controller.isMoving(); }
+    void stop() { controller.stop(); }
+    void update() { controller.update(); }
+
+    Driver& driver() { return chip; }
+    VelocityController<Driver>& velocity() { return controller; }
+};
+
+struct MotorConfig {
+  String name;
+  DriverConfig driver;
+  int current;  // mA RMS
+  double stepsPerUnit;
+  Velocity maxVelocity;
+  Acceleration acceleration;
+};
+
+// Positions in units, for any backend. The arguments after the config are
+// passed on to the backend's constructor. Positions are measured from the
+// limit switch once calibrate() has found it, as for a StepperMotor.
+template<class Backend>
+class Motor {
+  private:
+    MotorConfig config;
+    Backend motion;
+    int32_t target = 0;  // as last sent to the backend
+    int32_t homeSteps = 0;  // the switch's position in steps
+
+    int32_t to_backend_steps(int32_t steps) { return steps - limitSwitch.offset - homeSteps; }
+
+    void send_target(int32_t steps) {
+      target = steps;
+      motion.moveTo(steps);
+    }
+
+    // Stops a move into a pressed blocking switch. Moves away from it still
+    // go out, so the joint can back off.
+    void check_limit() {
+      if (!limitSwitch.isBlocking || limitSwitch.pin == -1) return;
+      limitSwitch.poll();
+      if (!limitSwitch.isPressed()) return;
+      int32_t remaining = target - motion.position();
+      if (limitSwitch.direction > 0 ? remaining > 0 : remaining < 0) stop();
+    }
+
+  public:
+    LimitSwitch limitSwitch;  // on an MCU pin only, set it before setup()
+
+    template<typename... Args>
+    Motor(MotorConfig config, Args&&... args) :
+      config(config),
+      motion(config.driver, static_cast<Args&&>(args)...)
+      { }
+
+    bool setup() {
+      if (!motion.begin(config.current)) return false;
+      motion.setLimits(config.maxVelocity, config.acceleration);
+      homeSteps = limitSwitch.position * config.stepsPerUnit;
+      limitSwitch.attach();
+      return true;
+    }
+
+    // Call from loop(). Backends that ramp from the host do their work here.
+    void update() {
+      motion.update();
+      check_limit();
+    }
+
+    // Drives toward the switch at a quarter of the top speed and zeroes the
+    // position where it's pressed. Blocks, and returns false if the switch
+    // wasn't reached within motorHomingTimeout. Without a switch, the motor
+    // stops and where it stands becomes the switch's position.
+    bool calibrate() {
+      homeSteps = limitSwitch.position * config.stepsPerUnit;
+      if (limitSwitch.pin == -1) {
+        stop();
+        limitSwitch.offset = -motion.position();
+        return true;
+      }
+
+      motion.setLimits({ config.maxVelocity.microstepsPerSecond / 4 }, config.acceleration);
+      unsigned long start = millis();
+      bool found = limitSwitch.isPressed();
+      if (!found) send_target(motion.position() + limitSwitch.direction * homingDistance);
+      while (!found && millis() - start < motorHomingTimeout) {
+        motion.update();
+        found = limitSwitch.isPressed();
+      }
+      stop();
+      if (found) limitSwitch.offset = -motion.position();
+      while (motion.isMoving() && millis() - start < motorHomingTimeout) motion.update();
+      motion.setLimits(config.maxVelocity, config.acceleration);
+      return found;
+    }
+
+    void setLimits(Velocity maxVelocity, Acceleration acceleration) { motion.setLimits(maxVelocity, acceleration); }
+    bool isMoving() { return motion.isMoving(); }
+
+    void stop() {
+      motion.stop();
+      target = motion.position();
+    }
+
+    int32_t currentSteps() { return motion.position() + limitSwitch.offset + homeSteps; }
+    double currentPosition() { return currentSteps() / config.stepsPerUnit; }
+
+    // Positions outside the switch's bounds are ignored
+    void moveTo(double position) {
+      if (!limitSwitch.isValid(position)) return;
+      moveToSteps(position * config.stepsPerUnit);
+    }
+
+    void moveBy(double offset) { moveBySteps(offset * config.stepsPerUnit); }
+    void moveToSteps(int32_t steps) { send_target(to_backend_steps(steps)); }
+    void moveBySteps(int32_t steps) { send_target(motion.position() + steps); }
+
+    bool isLimitPressed() { return limitSwitch.isPressed(); }
+    const String& name() const { return config.name; }
+    Backend& backend() { return motion; }
+    auto driver() -> decltype(motion.driver()) { return motion.driver(); }
+};
+
+using Tmc5130Motor = Motor<RampBackend<TMC5130Stepper>>;
+using Tmc5160Motor = Motor<RampBackend<TMC5160Stepper>>;
+using Tmc2209Motor = Motor<VactualBackend<TMC2209Stepper>>;
+template<class Driver>
+using StepDirMotor = Motor<StepDirBackend<Driver>>;
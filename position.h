@@ -0,0 +1,67 @@
+#pragma once
+#include <stdint.h>
+#include "fixed_point.h"
+
+// A joint position in Q16.16 units, for boards without an FPU. The joint's
+// microsteps per unit is the ratio microsteps / units, fixed at compile
+// time, so converting either way takes a few 64 bit multiplies instead of
+// soft-float math or a division, and rounds exactly. For example, a 50:1
+// joint in degrees is FixedPosition<51200 * 50, 360>.
+template<int32_t microsteps, int32_t units = 1>
+class FixedPosition {
+  static_assert(microsteps > 0 && units > 0, "the ratio must be positive");
+  static_assert(microsteps >= units, "needs at least one microstep per unit");
+  static_assert(microsteps / units < 65536, "too many microsteps per unit for Q16.16");
+
+  private:
+    // Microsteps per unit in Q16.32, split into its top and bottom 16 bits so
+    // neither product overflows
+    static constexpr uint64_t stepsFactor = (((uint64_t) microsteps << 32) + units / 2) / units;
+    static constexpr uint64_t stepsFactorHigh = stepsFactor >> 16;
+    static constexpr uint64_t stepsFactorLow = stepsFactor & 0xFFFF;
+
+    // Units per microstep in Q0.48, split into its top and bottom 24 bits.
+    // Built in two halves since units << 48 can overflow.
+    static constexpr uint64_t unitsFactor = (((uint64_t) units << 32) / microsteps << 16)
+      + ((((uint64_t) units << 32) % microsteps << 16) + microsteps / 2) / microsteps;
+    static constexpr uint64_t unitsFactorHigh = unitsFactor >> 24;
+    static constexpr uint64_t unitsFactorLow = unitsFactor & 0xFFFFFF;
+
+    // The factors get within one of the answer. What's left over from it
+    // then settles the rounding, half away from zero, with no division. The
+    // remainder is small, so it comes out right even though the products it's
+    // taken from wrap around. False if the result doesn't fit in 32 bits.
+    static bool settle(uint64_t whole, int64_t remainder, int64_t divisor, bool negative, int32_t& result) {
+      if (2 * remainder >= divisor) whole++;
+      else if (2 * remainder < -divisor) whole--;
+      if (whole > (negative ? 2147483648ull : 2147483647ull)) return false;
+      result = negative ? (int32_t) -(int64_t) whole : (int32_t) whole;
+      return true;
+    }
+
+  public:
+    q16 value;
+
+    constexpr FixedPosition() : value(0) { }
+    constexpr explicit FixedPosition(q16 value) : value(value) { }
+    static constexpr FixedPosition fromUnits(double position) { return FixedPosition(toQ16(position)); }
+
+    // False, leaving `steps` alone, if the position is beyond what XACTUAL
+    // can hold
+    bool toSteps(int32_t& steps) const {
+      bool negative = value < 0;
+      uint32_t magnitude = negative ? -(uint32_t) value : value;
+      uint64_t whole = ((uint64_t) magnitude * stepsFactorHigh + ((uint64_t) magnitude * stepsFactorLow >> 16) + (1ull << 31)) >> 32;
+      int64_t remainder = (uint64_t) magnitude * microsteps - (whole * units << 16);
+      return settle(whole, remainder, (int64_t) units << 16, negative, steps);
+    }
+
+    // False if the steps are beyond what Q16.16 can hold
+    static bool fromSteps(int32_t steps, FixedPosition& position) {
+      bool negative = steps < 0;
+      uint32_t magnitude = negative ? -(uint32_t) steps : steps;
+      uint64_t whole = ((uint64_t) magnitude * unitsFactorHigh + ((uint64_t) magnitude * unitsFactorLow >> 24) + 128) >> 8;
+      int64_t remainder = ((uint64_t) magnitude * units << 16) - whole * microsteps;
+      return settle(whole, remainder, microsteps, negative, position.value);
+    }
+};
@@ -0,0 +1,89 @@
+#include "ramp.h"
+
+// Register limits
+const uint32_t maxStartVelocity = (1ul << 18) - 1;  // VSTART, VSTOP
+const uint32_t maxTransitionVelocity = (1ul << 20) - 1;  // V1
+const uint32_t maxVelocity = (1ul << 23) - 512;  // VMAX
+const uint32_t minStopVelocity = 10;  // the datasheet's recommended minimum VSTOP
+
+static uint32_t clamp(uint32_t value, uint32_t maximum) {
+  return value > maximum ? maximum : value;
+}
+
+// Approximates an S-curve with the ramp's two acceleration stages. Below V1
+// the motor accelerates at half of AMAX, which is the average while a
+// jerk-limited profile builds up to AMAX, and it slows down the same way.
+// Load inertia takes away from the acceleration the motor's torque can give
+// and from the speed it can start at without stalling.
+RampParameters planRamp(const MotionLimits& limits, const ChipClock& clock) {
+  double load = 1 + limits.inertiaRatio;
+  RampParameters ramp;
+  ramp.vmax = clamp(clock.velocity(limits.maxVelocity), maxVelocity);
+  ramp.amax = clock.acceleration({limits.maxAcceleration.microstepsPerSecondSquared / load});
+  ramp.dmax = ramp.amax;
+
+  uint32_t start = clamp(clock.velocity({limits.startVelocity.microstepsPerSecond / load}), maxStartVelocity);
+  ramp.vstart = clamp(start, ramp.vmax);
+  ramp.vstop = ramp.vstart > minStopVelocity ? ramp.vstart : minStopVelocity;
+
+  uint32_t transition = clock.velocity(limits.transitionVelocity);
+  if (transition > ramp.vstart && transition < ramp.vmax) {
+    ramp.v1 = clamp(transition, maxTransitionVelocity);
+    ramp.a1 = ramp.amax > 1 ? ramp.amax / 2 : 1;
+    ramp.d1 = ramp.dmax > 1 ? ramp.dmax / 2 : 1;
+  } else {
+    ramp.v1 = 0;  // disables A1 and D1, but D1 must still not be 0
+    ramp.a1 = ramp.amax;
+    ramp.d1 = ramp.dmax;
+  }
+  return ramp;
+}
+
+// Distance and time to change speed from `from` to `to`, switching from
+// `low` to `high` acceleration at `knee`
+static double ramp_distance(double from, double to, double knee, double low, double high) {
+  if (knee < from) knee = from;
+  if (to <= knee) return (to * to - from * from) / (2 * low);
+  return (knee * knee - from * from) / (2 * low) + (to * to - knee * knee) / (2 * high);
+}
+
+static double ramp_time(double from, double to, double knee, double low, double high) {
+  if (knee < from) knee = from;
+  if (to <= knee) return (to - from) / low;
+  return (knee - from) / low + (to - knee) / high;
+}
+
+// Predicts how many seconds a move of `distance` microsteps takes from
+// standstill, following the same phases as the driver. Moves too short to
+// reach VMAX peak at the speed where the ramps up and down meet.
+double moveTime(const RampParameters& ramp, double distance, const ChipClock& clock) {
+  if (distance < 0) distance = -distance;
+  if (distance == 0) return 0;
+  double vstart = clock.toVelocity(ramp.vstart).microstepsPerSecond;
+  double v1 = clock.toVelocity(ramp.v1).microstepsPerSecond;
+  double vmax = clock.toVelocity(ramp.vmax).microstepsPerSecond;
+  double vstop = clock.toVelocity(ramp.vstop).microstepsPerSecond;
+  double a1 = clock.toAcceleration(ramp.a1).microstepsPerSecondSquared;
+  double amax = clock.toAcceleration(ramp.amax).microstepsPerSecondSquared;
+  double dmax = clock.toAcceleration(ramp.dmax).microstepsPerSecondSquared;
+  double d1 = clock.toAcceleration(ramp.d1).microstepsPerSecondSquared;
+  if (ramp.v1 == 0) v1 = 0;  // single stage ramps
+  if (vmax <= 0) return INFINITY;
+  if (vstart > vmax) vstart = vmax;
+  if (vstop > vmax) vstop = vmax;
+
+  double peak = vmax;
+  double ramps = ramp_distance(vstart, vmax, v1, a1, amax) + ramp_distance(vstop, vmax, v1, d1, dmax);
+  if (ramps > distance) {
+    double low = vstart > vstop ? vstart : vstop, high = vmax;
+    for (int step = 0; step < 32; step++) {
+      peak = (low + high) / 2;
+      ramps = ramp_distance(vstart, peak, v1, a1, amax) + ramp_distance(vstop, peak, v1, d1, dmax);
+      if (ramps > distance) high = peak;
+      else low = peak;
+    }
+  }
+
+  double cruise = distance > ramps ? (distance - ramps) / peak : 0;
+  return ramp_time(vstart, peak, v1, a1, amax) + cruise + ramp_time(vstop, peak, v1, d1, dmax);
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <Arduino.h>
+#include "units.h"
+
+// The TMC5160's six point ramp, in chip units
+struct RampParameters {
+  uint32_t vstart;
+  uint16_t a1;
+  uint32_t v1;
+  uint16_t amax;
+  uint32_t vmax;
+  uint16_t dmax;
+  uint16_t d1;
+  uint32_t vstop;
+};
+
+// What a joint can physically do
+struct MotionLimits {
+  Velocity maxVelocity;
+  Acceleration maxAcceleration;  // with no load on the motor
+  Velocity transitionVelocity;   // where the acceleration reaches its full value
+  Velocity startVelocity = {0};  // what the unloaded motor can jump to from standstill
+  double inertiaRatio = 0;       // load inertia over rotor inertia
+};
+
+RampParameters planRamp(const MotionLimits& limits, const ChipClock& clock = internalClock);
+double moveTime(const RampParameters& ramp, double distance, const ChipClock& clock = internalClock);
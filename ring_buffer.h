@@ -0,0 +1,33 @@
+#pragma once
+
+// A fixed-capacity FIFO queue. Never allocates.
+template<typename T, int capacity>
+class RingBuffer {
+  private:
+    T items[capacity];
+    int head = 0;
+    int count = 0;
+
+  public:
+    bool isEmpty() const { return count == 0; }
+    bool isFull() const { return count == capacity; }
+    int size() const { return count; }
+    void clear() { head = 0; count = 0; }
+
+    bool push(const T& item) {
+      if (isFull()) return false;
+      items[(head + count) % capacity] = item;
+      count++;
+      return true;
+    }
+
+    bool pop(T& item) {
+      if (isEmpty()) return false;
+      item = items[head];
+      head = (head + 1) % capacity;
+      count--;
+      return true;
+    }
+
+    const T& peek() const { return items[head]; }
+};
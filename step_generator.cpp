@@ -0,0 +1,155 @@
+#include <new>
+#include "step_generator.h"
+
+const double rateScale = 4294967296.0;  // 2^32, one step
+const uint32_t maxRate = 0x80000000;  // a step every other tick
+
+StepGenerator::StepGenerator(double frequency) :
+  frequency(frequency)
+  { }
+
+// Returns the axis number, or -1 if there's no room
+int StepGenerator::addAxis(StepDirPins pins) {
+  if (count == maxAxes) return -1;
+  // The pins can't be reassigned, so the axis is rebuilt in place
+  Axis* axis = new (&axes[count]) Axis(pins);
+  axis->stepPin.setMode();
+  axis->directionPin.setMode();
+  axis->stepPin.reset();
+  return count++;
+}
+
+uint32_t StepGenerator::to_rate(Velocity velocity) {
+  double rate = velocity.microstepsPerSecond / frequency * rateScale;
+  if (rate <= 0) return 0;
+  if (rate >= maxRate) return maxRate;
+  return rate;
+}
+
+// Velocities are in the driver's microsteps, one per pulse. Takes effect on
+// the next move.
+void StepGenerator::setLimits(int axis, Velocity maxVelocity, Acceleration acceleration, Velocity startVelocity) {
+  Axis& limits = axes[axis];
+  double perTick = acceleration.microstepsPerSecondSquared / (frequency * frequency) * rateScale;
+  limits.maxRate = to_rate(maxVelocity);
+  limits.startRate = to_rate(startVelocity);
+  limits.acceleration = perTick < 1 ? 1 : perTick >= maxRate ? maxRate : perTick;
+  if (limits.maxRate == 0) limits.maxRate = 1;
+  if (limits.startRate > limits.maxRate) limits.startRate = limits.maxRate;
+
+  // The speed after one step from standstill
+  uint32_t firstStep = to_rate({sqrt(2 * acceleration.microstepsPerSecondSquared)});
+  limits.stopRate = limits.startRate > firstStep ? limits.startRate : firstStep;
+  if (limits.stopRate > limits.maxRate) limits.stopRate = limits.maxRate;
+  if (limits.stopRate == 0) limits.stopRate = 1;
+}
+
+// While set, steps go to the callback instead of the pins, for simulating
+// moves on a computer
+void StepGenerator::onStep(StepCallback callback) {
+  this->callback = callback;
+}
+
+// A moving axis takes a new target in the direction it's already going.
+// Returns false if the target is behind it, call stop() first.
+bool StepGenerator::moveTo(int axis, int32_t position) {
+  return moveBy(axis, position - this->position(axis));
+}
+
+bool StepGenerator::moveBy(int axis, int32_t steps) {
+  Axis& move = axes[axis];
+  if (steps == 0) return true;
+  int8_t direction = steps > 0 ? 1 : -1;
+  uint32_t distance = steps > 0 ? steps : -steps;
+
+  noInterrupts();
+  if (move.active && direction != move.direction) {
+    interrupts();
+    return false;
+  }
+  if (!move.active) {
+    move.direction = direction;
+    if (callback == nullptr) move.directionPin.write(direction > 0);
+    move.rate = move.startRate;
+    move.phase = 0;
+    move.rampSteps = 0;
+  }
+  move.remaining = distance;
+  move.active = true;
+  interrupts();
+  return true;
+}
+
+// Slows down with the axis's acceleration and stops
+void StepGenerator::stop(int axis) {
+  Axis& move = axes[axis];
+  noInterrupts();
+  if (move.remaining > move.rampSteps) move.remaining = move.rampSteps;
+  if (move.remaining == 0) move.active = false;
+  interrupts();
+}
+
+bool StepGenerator::isMoving(int axis) {
+  return axes[axis].active;
+}
+
+int32_t StepGenerator::position(int axis) {
+  noInterrupts();
+  int32_t position = axes[axis].position;
+  interrupts();
+  return position;
+}
+
+uint32_t StepGenerator::elapsedTicks() {
+  noInterrupts();
+  uint32_t elapsed = ticks;
+  interrupts();
+  return elapsed;
+}
+
+// Call at the frequency passed to the constructor, usually from a timer
+// interrupt
+void StepGenerator::tick() {
+  ticks = ticks + 1;
+  for (int index = 0; index < count; index++) {
+    Axis& axis = axes[index];
+    if (!axis.active) continue;
+    update_rate(axis);
+    uint32_t phase = axis.phase + axis.rate;
+    bool wrapped = phase < axis.phase;
+    axis.phase = phase;
+    if (wrapped) step(index, axis);
+  }
+}
+
+// Speeding up takes as many steps as slowing down from the same speed, so
+// the axis starts to slow down once the steps left match those it took to
+// speed up. Short moves never reach full speed and ramp down from halfway.
+void StepGenerator::update_rate(Axis& axis) {
+  axis.speedingUp = false;
+  if (axis.remaining <= axis.rampSteps) {
+    axis.rate = axis.rate > axis.stopRate + axis.acceleration ? axis.rate - axis.acceleration : axis.stopRate;
+  } else if (axis.rate < axis.maxRate) {
+    axis.rate = axis.maxRate - axis.rate > axis.acceleration ? axis.rate + axis.acceleration : axis.maxRate;
+    axis.speedingUp = true;
+  }
+}
+
+void StepGenerator::step(int index, Axis& axis) {
+  if (axis.speedingUp) axis.rampSteps++;
+  axis.position = axis.position + axis.direction;
+  axis.remaining = axis.remaining - 1;
+  if (axis.remaining == 0) axis.active = false;
+
+  if (callback != nullptr) {
+    StepEvent event;
+    event.axis = index;
+    event.direction = axis.direction;
+    event.tick = ticks;
+    callback(event);
+    return;
+  }
+  axis.stepLevel = !axis.stepLevel;
+  if (axis.stepLevel) axis.stepPin.set();
+  else axis.stepPin.reset();
+}
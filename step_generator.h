@@ -0,0 +1,88 @@
+#pragma once
+#include <Arduino.h>
+#include "TmcStepper.h"
+#include "units.h"
+
+const int maxAxes = 4;
+
+struct StepDirPins {
+  int step;
+  int direction;
+};
+
+struct StepEvent {
+  uint8_t axis;
+  int8_t direction;
+  uint32_t tick;  // ticks since the generator started
+};
+
+// Replaces the pin writes, to simulate the generator off the board
+using StepCallback = void (*)(const StepEvent& event);
+
+// Drives STEP/DIR drivers such as the TMC2208, TMC2209 and TMC2300, which
+// have no ramp generator of their own. Call tick() at a fixed frequency
+// from a hardware timer interrupt, and every axis steps from that one timer.
+//
+// Each axis is a DDA: its speed, in steps per tick, is added to a phase
+// every tick and a step is taken when the phase wraps. Speeding up and
+// slowing down add or subtract a constant from the speed, so the ramp is
+// trapezoidal and the interrupt never divides. Steps toggle the STEP pin,
+// so enable double edge stepping on the driver with dedge(true). The pins
+// are written through TMC_HAL::OutputPin, which is a single port write on
+// AVR rather than a digitalWrite().
+class StepGenerator {
+  private:
+    // Speeds are steps per tick and accelerations steps per tick², both in
+    // Q0.32, so one wrap of the phase is one step
+    struct Axis {
+      TMC_HAL::OutputPin stepPin;
+      TMC_HAL::OutputPin directionPin;
+      uint32_t maxRate = 0;
+      uint32_t startRate = 0;
+      uint32_t stopRate = 0;  // never slows below this, so the last step comes
+      uint32_t acceleration = 0;
+
+      // Shared with tick()
+      volatile bool active = false;
+      volatile int32_t position = 0;
+      volatile uint32_t remaining = 0;
+      int8_t direction = 1;
+      uint32_t rate = 0;
+      uint32_t phase = 0;
+      uint32_t rampSteps = 0;  // taken while speeding up, and so needed to stop
+      bool speedingUp = false;
+      bool stepLevel = false;
+
+      // Unused axes hold pin 0 until addAxis() builds them in place
+      Axis(StepDirPins pins = { 0, 0 }) :
+        stepPin(pins.step),
+        directionPin(pins.direction)
+        { }
+    };
+
+    Axis axes[maxAxes];
+    int count = 0;
+    double frequency;
+    volatile uint32_t ticks = 0;
+    StepCallback callback = nullptr;
+
+    uint32_t to_rate(Velocity velocity);
+    void update_rate(Axis& axis);
+    void step(int index, Axis& axis);
+
+  public:
+    StepGenerator(double frequency);
+
+    int addAxis(StepDirPins pins);
+    void setLimits(int axis, Velocity maxVelocity, Acceleration acceleration, Velocity startVelocity = {0});
+    void onStep(StepCallback callback);
+
+    bool moveTo(int axis, int32_t position);
+    bool moveBy(int axis, int32_t steps);
+    void stop(int axis);
+    bool isMoving(int axis);
+    int32_t position(int axis);
+    uint32_t elapsedTicks();
+
+    void tick();
+};
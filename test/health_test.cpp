@@ -0,0 +1,67 @@
+// Host test for health.cpp against fake TMC5160s. Build and run from the
+// repository root on a computer:
+//
+//   g++ -std=gnu++11 -DARDUINO=10819 -DF_CPU=16000000L -Itest/host -I. test/health_test.cpp test/host/host.cpp health.cpp arm.cpp BURT_TMC.cpp limit.cpp interrupt.cpp ramp.cpp TMC_Stepper/*.cpp TMC_Stepper/TMC_HAL/TMC_HAL_Arduino.cpp -o health_test && ./health_test
+#include <stdio.h>
+#include "health.h"
+#include "host.h"
+
+const uint8_t gstat = 0x01;
+const uint8_t ioin = 0x04;
+const uint8_t drvStatus = 0x6F;
+const int jointCount = 3;
+
+static bool failed = false;
+
+static void check(bool condition, const char* message) {
+  printf("%s: %s\n", condition ? "ok" : "FAIL", message);
+  if (!condition) failed = true;
+}
+
+static unsigned long healthReads(const FakeTmc5160& driver) {
+  return driver.reads[drvStatus] + driver.reads[gstat] + driver.reads[ioin];
+}
+
+// GSTAT.drv_err stays latched after a fault has cleared, so DRV_STATUS reads
+// clean while the status byte still shows a driver error. That joint must
+// not be picked as urgent forever.
+static void latchedDriverError() {
+  FakeTmc5160* fakes[jointCount] = { &addFakeDriver(10), &addFakeDriver(11), &addFakeDriver(12) };
+  StepperMotor swivel({ 2, 10 }, { "swivel", 1000, 1000, 100, 10.0 });
+  StepperMotor lift({ 3, 11 }, { "lift", 1000, 1000, 100, 10.0 });
+  StepperMotor extend({ 4, 12 }, { "extend", 1000, 1000, 100, 10.0 });
+  StepperMotor* joints[jointCount] = { &swivel, &lift, &extend };
+  Arm arm(joints, jointCount);
+  arm.setup();
+  check(arm.onlineCount() == jointCount, "every joint comes up");
+
+  FakeTmc5160& faulty = *fakes[0];
+  faulty.registers[gstat] |= 2;  // drv_err
+  faulty.heldGstat = 2;
+  swivel.refresh();  // the status byte now shows the error
+  for (int index = 0; index < jointCount; index++) {
+    for (int reg = 0; reg < 128; reg++) fakes[index]->reads[reg] = 0;
+  }
+
+  HealthMonitor monitor(arm);
+  for (int step = 0; step < 2000; step++) {
+    advanceMicros(1000);
+    monitor.update();
+  }
+
+  unsigned long total = 0;
+  for (int index = 0; index < jointCount; index++) total += healthReads(*fakes[index]);
+  printf("health reads: %lu, %lu, %lu\n", healthReads(*fakes[0]), healthReads(*fakes[1]), healthReads(*fakes[2]));
+  check(faulty.reads[gstat] > 0, "the faulty joint's GSTAT is read");
+  check(monitor.motorHealth(0).faults & faultDriverError, "the driver error is reported");
+  for (int index = 1; index < jointCount; index++) {
+    const FakeTmc5160& other = *fakes[index];
+    check(other.reads[drvStatus] > 0 && other.reads[gstat] > 0 && other.reads[ioin] > 0, "the other joints still get every register read");
+    check(healthReads(other) * 2 * jointCount >= total, "the other joints get a fair share of the reads");
+  }
+}
+
+int main() {
+  latchedDriverError();
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,71 @@
+#pragma once
+// Just enough of the Arduino API to build the library on a computer for the
+// host tests. Time only moves when the program asks for it, by one µs per
+// call, so busy waits still finish.
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define PI 3.14159265358979
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+class String : public std::string {
+  public:
+    String(const char* text = "") : std::string(text) { }
+};
+
+class Print {
+  public:
+    size_t print(const char* text);
+    size_t print(const String& text);
+    size_t print(int value, int base = 10);
+    size_t print(unsigned int value, int base = 10);
+    size_t print(long value, int base = 10);
+    size_t print(unsigned long value, int base = 10);
+    size_t print(double value, int digits = 2);
+    size_t println(const char* text = "");
+    size_t println(const String& text);
+    size_t println(int value, int base = 10);
+    size_t println(unsigned int value, int base = 10);
+    size_t println(long value, int base = 10);
+    size_t println(unsigned long value, int base = 10);
+    size_t println(double value, int digits = 2);
+};
+
+class HardwareSerial : public Print {
+  public:
+    void begin(unsigned long baud);
+    void end();
+    int available();
+    size_t readBytes(uint8_t* buffer, size_t length);
+    size_t write(const uint8_t* buffer, size_t length);
+    void flush();
+};
+
+extern HardwareSerial Serial;
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+#define NOT_AN_INTERRUPT -1
+int digitalPinToInterrupt(uint8_t pin);  // as on a Mega: pins 2, 3 and 18 to 21
+void attachInterrupt(uint8_t interrupt, void (*handler)(void), int mode);
+void detachInterrupt(uint8_t interrupt);
+void noInterrupts();
+void interrupts();
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
@@ -0,0 +1,21 @@
+#pragma once
+#include "Arduino.h"
+
+#define MSBFIRST 1
+#define SPI_MODE3 3
+
+struct SPISettings {
+  SPISettings(uint32_t clock, uint8_t bitOrder, uint8_t mode) { }
+};
+
+// Hands every transfer to the fake drivers in host.h
+class SPIClass {
+  public:
+    void begin();
+    void beginTransaction(SPISettings settings);
+    void transfer(uint8_t* buffer, size_t count);
+    uint8_t transfer(uint8_t value);
+    void endTransaction();
+};
+
+extern SPIClass SPI;
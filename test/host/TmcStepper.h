@@ -0,0 +1,4 @@
+#pragma once
+// BURT_TMC.h includes the library by this name, which only resolves on
+// case-insensitive file systems
+#include "../../TMCStepper.h"
@@ -0,0 +1,183 @@
+#include "host.h"
+#include <stdio.h>
+#include <string.h>
+#include "SPI.h"
+
+HardwareSerial Serial;
+SPIClass SPI;
+
+static unsigned long now = 0;  // µs
+static uint8_t levels[256];
+static FakeTmc5160 drivers[maxFakeDrivers];
+static int driverCount = 0;
+static FakeTmc2209 uartDriver;
+static uint8_t received[8];  // bytes waiting on Serial
+static size_t receivedCount = 0;
+
+// Registers of the TMC5160 that the fake gives meaning to
+const uint8_t gstatAddress = 0x01;
+const uint8_t ioinAddress = 0x04;
+const uint8_t xactualAddress = 0x21;
+const uint8_t xtargetAddress = 0x2D;
+const uint8_t rampStatAddress = 0x35;
+const uint8_t drvStatusAddress = 0x6F;
+
+const uint32_t ioinVersion = 0x30ul << 24;
+const uint32_t rampReached = (1ul << 8) | (1ul << 9) | (1ul << 10);  // velocity, position, vzero
+const uint32_t standstill = 1ul << 31;
+const uint32_t rampStatLatches = 0x10FC;  // the latch and event flags, the rest is live status
+
+void FakeTmc5160::powerOn() {
+  memset(registers, 0, sizeof(registers));
+  registers[gstatAddress] = 1;  // reset
+  registers[ioinAddress] = ioinVersion;
+  registers[rampStatAddress] = rampReached;
+  registers[drvStatusAddress] = standstill;
+}
+
+// reset_flag and driver_error from GSTAT, then standstill, velocity reached
+// and position reached, since every move has already finished
+uint8_t FakeTmc5160::status() const {
+  return (registers[gstatAddress] & 3) | (1 << 3) | (1 << 4) | (1 << 5);
+}
+
+void FakeTmc5160::datagram(uint8_t* buffer) {
+  uint8_t address = buffer[0] & 0x7F;
+  bool isWrite = buffer[0] & 0x80;
+  uint32_t data = (uint32_t) buffer[1] << 24 | (uint32_t) buffer[2] << 16 | (uint32_t) buffer[3] << 8 | buffer[4];
+
+  buffer[0] = status();
+  buffer[1] = reply >> 24;
+  buffer[2] = reply >> 16;
+  buffer[3] = reply >> 8;
+  buffer[4] = reply;
+
+  if (!isWrite) {
+    reads[address]++;
+    reply = registers[address];
+    return;
+  }
+  writes[address]++;
+  reply = 0;
+  if (address == gstatAddress) {
+    registers[address] &= ~data | heldGstat;  // write one to clear
+  } else if (address == rampStatAddress) {
+    registers[address] &= ~(data & rampStatLatches);
+  } else if (address == xtargetAddress) {
+    registers[xtargetAddress] = data;
+    registers[xactualAddress] = data;
+  } else {
+    registers[address] = data;
+  }
+}
+
+FakeTmc5160& addFakeDriver(uint8_t chipSelect) {
+  FakeTmc5160& driver = drivers[driverCount++];
+  driver.chipSelect = chipSelect;
+  driver.powerOn();
+  return driver;
+}
+
+void advanceMicros(unsigned long us) { now += us; }
+
+unsigned long micros() { return ++now; }
+unsigned long millis() { return ++now / 1000; }
+void delay(unsigned long ms) { now += ms * 1000; }
+void delayMicroseconds(unsigned int us) { now += us; }
+
+void pinMode(uint8_t, uint8_t) { }
+void digitalWrite(uint8_t pin, uint8_t value) { levels[pin] = value; }
+int digitalRead(uint8_t pin) { return levels[pin]; }
+int digitalPinToInterrupt(uint8_t pin) {
+  if (pin == 2 || pin == 3) return pin - 2;
+  return pin >= 18 && pin <= 21 ? 23 - pin : NOT_AN_INTERRUPT;
+}
+void attachInterrupt(uint8_t, void (*)(void), int) { }
+void detachInterrupt(uint8_t) { }
+void noInterrupts() { }
+void interrupts() { }
+
+void SPIClass::begin() { }
+void SPIClass::beginTransaction(SPISettings) { }
+void SPIClass::endTransaction() { }
+
+uint8_t SPIClass::transfer(uint8_t value) {
+  transfer(&value, 1);
+  return value;
+}
+
+// Whole datagrams go to whichever fake driver is selected
+void SPIClass::transfer(uint8_t* buffer, size_t count) {
+  for (int index = 0; index < driverCount; index++) {
+    if (levels[drivers[index].chipSelect] == LOW && count == 5) {
+      drivers[index].datagram(buffer);
+      return;
+    }
+  }
+  memset(buffer, 0, count);
+}
+
+// The tests print their own results, so the library's messages are dropped
+size_t Print::print(const char*) { return 0; }
+size_t Print::print(const String&) { return 0; }
+size_t Print::print(int, int) { return 0; }
+size_t Print::print(unsigned int, int) { return 0; }
+size_t Print::print(long, int) { return 0; }
+size_t Print::print(unsigned long, int) { return 0; }
+size_t Print::print(double, int) { return 0; }
+size_t Print::println(const char*) { return 0; }
+size_t Print::println(const String&) { return 0; }
+size_t Print::println(int, int) { return 0; }
+size_t Print::println(unsigned int, int) { return 0; }
+size_t Print::println(long, int) { return 0; }
+size_t Print::println(unsigned long, int) { return 0; }
+size_t Print::println(double, int) { return 0; }
+
+FakeTmc2209& fakeUartDriver() { return uartDriver; }
+
+// The CRC of the TMC22xx datagrams, over all but the last byte
+static uint8_t uart_crc(const uint8_t* datagram, size_t length) {
+  uint8_t crc = 0;
+  for (size_t index = 0; index + 1 < length; index++) {
+    uint8_t byte = datagram[index];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = ((crc >> 7) ^ (byte & 1)) ? (crc << 1) ^ 0x07 : crc << 1;
+      byte >>= 1;
+    }
+  }
+  return crc;
+}
+
+void HardwareSerial::begin(unsigned long) { }
+void HardwareSerial::end() { }
+int HardwareSerial::available() { return receivedCount; }
+
+size_t HardwareSerial::readBytes(uint8_t* buffer, size_t length) {
+  if (length > receivedCount) length = receivedCount;
+  memcpy(buffer, received, length);
+  memmove(received, received + length, receivedCount - length);
+  receivedCount -= length;
+  return length;
+}
+
+// A read request gets its reply at once, and a write is stored
+size_t HardwareSerial::write(const uint8_t* buffer, size_t length) {
+  uint8_t address = buffer[2] & 0x7F;
+  if (length == 8) {
+    uartDriver.registers[address] = (uint32_t) buffer[3] << 24 | (uint32_t) buffer[4] << 16 | (uint32_t) buffer[5] << 8 | buffer[6];
+  } else if (length == 4) {
+    uint32_t value = uartDriver.registers[address];
+    uint8_t reply[8] = { 0x05, 0xFF, address, (uint8_t) (value >> 24), (uint8_t) (value >> 16), (uint8_t) (value >> 8), (uint8_t) value, 0 };
+    reply[7] = uart_crc(reply, 8);
+    if (uartDriver.corruptReplies > 0) {
+      uartDriver.corruptReplies--;
+      reply[7] ^= 0xFF;
+    }
+    uartDriver.reads[address]++;
+    memcpy(received, reply, 8);
+    receivedCount = 8;
+  }
+  return length;
+}
+
+void HardwareSerial::flush() { }
@@ -0,0 +1,36 @@
+#pragma once
+// Fake TMC5160s on the fake SPI bus, for host tests that run the motor code
+#include "Arduino.h"
+
+const int maxFakeDrivers = 8;
+
+// Answers SPI datagrams like a TMC5160: each reply carries the status byte
+// and the register asked for by the previous datagram. A move to XTARGET
+// finishes at once.
+struct FakeTmc5160 {
+  uint8_t chipSelect = 0;
+  uint32_t registers[128] = {};
+  uint32_t reply = 0;
+  uint8_t heldGstat = 0;  // GSTAT bits that a write can't clear, like a fault that persists
+  unsigned long reads[128] = {};
+  unsigned long writes[128] = {};
+
+  void powerOn();
+  uint8_t status() const;
+  void datagram(uint8_t* buffer);
+};
+
+// Registers a fake driver on a chip select pin and powers it on
+FakeTmc5160& addFakeDriver(uint8_t chipSelect);
+
+// Answers UART datagrams on Serial like a TMC2209, at any address. The next
+// corruptReplies replies go out with a bad CRC.
+struct FakeTmc2209 {
+  uint32_t registers[128] = {};
+  int corruptReplies = 0;
+  unsigned long reads[128] = {};
+};
+
+FakeTmc2209& fakeUartDriver();
+
+void advanceMicros(unsigned long us);
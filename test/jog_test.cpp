@@ -0,0 +1,70 @@
+// Host test for leaving the jog's velocity mode, against a fake TMC5160.
+// Build and run from the repository root on a computer:
+//
+//   g++ -std=gnu++11 -DARDUINO=10819 -DF_CPU=16000000L -Itest/host -I. test/jog_test.cpp test/host/host.cpp BURT_TMC.cpp limit.cpp interrupt.cpp ramp.cpp TMC_Stepper/*.cpp TMC_Stepper/TMC_HAL/TMC_HAL_Arduino.cpp -o jog_test && ./jog_test
+#include <stdio.h>
+#include "BURT_TMC.h"
+#include "host.h"
+
+const uint8_t rampMode = 0x20;
+const uint8_t vmax = 0x27;
+const uint8_t xtarget = 0x2D;
+const uint8_t rampStat = 0x35;
+const uint32_t vzero = 1ul << 10;
+
+static bool failed = false;
+
+static void check(bool condition, const char* message) {
+  printf("%s: %s\n", condition ? "ok" : "FAIL", message);
+  if (!condition) failed = true;
+}
+
+// The motor is still turning, so vzero is clear until the test sets it
+static void startJog(StepperMotor& motor, FakeTmc5160& fake) {
+  motor.jog(1.0);
+  fake.registers[rampStat] &= ~vzero;
+}
+
+// Stopping a jog returns at once. A move made while the motor slows down
+// goes out from update() once the driver reports vzero.
+static void moveWhileSlowingDown() {
+  FakeTmc5160& fake = addFakeDriver(10);
+  StepperMotor motor({ 2, 10 }, { "lift", 1000, 1000, 100, 10.0 });
+  check(motor.setup(), "the motor comes up");
+  startJog(motor, fake);
+  check(fake.registers[rampMode] == 1 && fake.registers[vmax] != 0, "the jog runs in velocity mode");
+
+  motor.stop();
+  check(!motor.isJogging() && motor.isMoving(), "stop() returns while the motor slows down");
+  check(fake.registers[rampMode] == 1 && fake.registers[vmax] == 0, "the driver ramps down in velocity mode");
+
+  unsigned long targetWrites = fake.writes[xtarget];
+  motor.moveToSteps(500);
+  motor.update();
+  check(fake.writes[xtarget] == targetWrites && fake.registers[vmax] == 0, "a move waits for the motor to stop");
+
+  fake.registers[rampStat] |= vzero;
+  motor.update();
+  check(fake.registers[rampMode] == 0, "the driver is back in positioning mode");
+  check(fake.registers[xtarget] == 500 && fake.registers[vmax] != 0, "the move goes out");
+}
+
+// A driver that never reports vzero can't hold the motor in velocity mode
+static void vzeroNeverComes() {
+  FakeTmc5160& fake = addFakeDriver(11);
+  StepperMotor motor({ 3, 11 }, { "swivel", 1000, 1000, 100, 10.0 });
+  check(motor.setup(), "the motor comes up");
+  startJog(motor, fake);
+  motor.stopJog();
+  motor.update();
+  check(fake.registers[rampMode] == 1, "the driver is still in velocity mode");
+  advanceMicros(6000000);
+  motor.update();
+  check(fake.registers[rampMode] == 0 && !motor.isMoving(), "the motor gives up on vzero and holds where it is");
+}
+
+int main() {
+  moveWhileSlowingDown();
+  vzeroNeverComes();
+  return failed ? 1 : 0;
+}
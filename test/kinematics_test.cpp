@@ -0,0 +1,132 @@
+// Host test for kinematics.cpp: accuracy of the float and Q16.16 solvers
+// against a double precision reference, and solves per second. Build and
+// run from the repository root on a computer:
+//
+//   g++ -std=gnu++11 -O2 -I. test/kinematics_test.cpp kinematics.cpp -o kinematics_test && ./kinematics_test
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include "kinematics.h"
+
+const double maxAngleError = 0.001;  // rad
+const double maxExtendError = 0.005;  // length units
+const int benchmarkSolves = 1000000;
+
+struct Reference {
+  GripperPose<double> pose;
+  JointAngles<double> joints;
+};
+
+const ArmGeometry<double> geometry = { 10, 20, 40, 8 };
+
+static GripperPose<double> forward(const JointAngles<double>& joints) {
+  double boom = geometry.minExtension + joints.extend;
+  double pitch = joints.lift + joints.gripperLift;
+  double reach = boom * cos(joints.lift) + geometry.gripperLength * cos(pitch);
+  GripperPose<double> pose;
+  pose.x = reach * cos(joints.swivel);
+  pose.y = reach * sin(joints.swivel);
+  pose.z = geometry.shoulderHeight + boom * sin(joints.lift) + geometry.gripperLength * sin(pitch);
+  pose.pitch = pitch;
+  return pose;
+}
+
+// Joint angles spread over the arm's range, away from the ends of the
+// extend joint where rounding decides reachability, with their poses
+static int references(Reference* out, int capacity) {
+  int count = 0;
+  for (double swivel = -3; swivel <= 3; swivel += 0.5) {
+    for (double lift = -0.6; lift <= 1.2; lift += 0.3) {
+      for (double extend = 1; extend <= 19; extend += 3) {
+        for (double gripperLift = -1.2; gripperLift <= 0.6; gripperLift += 0.3) {
+          if (count == capacity) return count;
+          Reference& reference = out[count++];
+          reference.joints = { swivel, lift, extend, gripperLift };
+          reference.pose = forward(reference.joints);
+        }
+      }
+    }
+  }
+  return count;
+}
+
+struct Errors {
+  double angle = 0;
+  double extend = 0;
+  int unreachable = 0;
+};
+
+static void track(Errors& errors, const JointAngles<double>& expected, double swivel, double lift, double extend, double gripperLift) {
+  double angles[] = { swivel - expected.swivel, lift - expected.lift, gripperLift - expected.gripperLift };
+  for (double error : angles) {
+    error = fabs(remainder(error, 2 * M_PI));
+    if (error > errors.angle) errors.angle = error;
+  }
+  if (fabs(extend - expected.extend) > errors.extend) errors.extend = fabs(extend - expected.extend);
+}
+
+static bool report(const char* name, const Errors& errors) {
+  bool ok = errors.angle <= maxAngleError && errors.extend <= maxExtendError && errors.unreachable == 0;
+  printf("%-6s max angle error %.6f rad, max extend error %.6f, %d unreachable: %s\n",
+    name, errors.angle, errors.extend, errors.unreachable, ok ? "ok" : "FAIL");
+  return ok;
+}
+
+template<typename Solve>
+static void benchmark(const char* name, Solve solve) {
+  auto start = std::chrono::steady_clock::now();
+  int reachable = 0;
+  for (int i = 0; i < benchmarkSolves; i++) reachable += solve(i);
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("%-6s %.0f solves/s on this computer (%d reachable)\n", name, benchmarkSolves / seconds, reachable);
+}
+
+int main() {
+  static Reference cases[4096];
+  int count = references(cases, 4096);
+
+  const ArmGeometry<float> floatGeometry = { 10, 20, 40, 8 };
+  const ArmGeometry<q16> fixedGeometry = { toQ16(10), toQ16(20), toQ16(40), toQ16(8) };
+  Errors floatErrors, fixedErrors;
+  for (int i = 0; i < count; i++) {
+    const GripperPose<double>& pose = cases[i].pose;
+
+    GripperPose<float> floatPose = { (float) pose.x, (float) pose.y, (float) pose.z, (float) pose.pitch };
+    JointAngles<float> floatJoints;
+    if (!inverseKinematics(floatGeometry, floatPose, floatJoints)) floatErrors.unreachable++;
+    track(floatErrors, cases[i].joints, floatJoints.swivel, floatJoints.lift, floatJoints.extend, floatJoints.gripperLift);
+
+    GripperPose<q16> fixedPose = { toQ16(pose.x), toQ16(pose.y), toQ16(pose.z), toQ16(pose.pitch) };
+    JointAngles<q16> fixedJoints;
+    if (!inverseKinematics(fixedGeometry, fixedPose, fixedJoints)) fixedErrors.unreachable++;
+    track(fixedErrors, cases[i].joints, fromQ16(fixedJoints.swivel), fromQ16(fixedJoints.lift),
+      fromQ16(fixedJoints.extend), fromQ16(fixedJoints.gripperLift));
+  }
+  printf("%d poses\n", count);
+  bool ok = report("float", floatErrors);
+  ok = report("q16", fixedErrors) && ok;
+
+  // Keeps the compiler from dropping the solves
+  volatile float floatSink = 0;
+  volatile q16 fixedSink = 0;
+  benchmark("float", [&](int i) {
+    const GripperPose<double>& pose = cases[i % count].pose;
+    GripperPose<float> floatPose = { (float) pose.x, (float) pose.y, (float) pose.z, (float) pose.pitch };
+    JointAngles<float> joints;
+    bool reachable = inverseKinematics(floatGeometry, floatPose, joints);
+    floatSink = joints.lift;
+    return reachable;
+  });
+  static GripperPose<q16> fixedPoses[4096];
+  for (int i = 0; i < count; i++) {
+    const GripperPose<double>& pose = cases[i].pose;
+    fixedPoses[i] = { toQ16(pose.x), toQ16(pose.y), toQ16(pose.z), toQ16(pose.pitch) };
+  }
+  benchmark("q16", [&](int i) {
+    JointAngles<q16> joints;
+    bool reachable = inverseKinematics(fixedGeometry, fixedPoses[i % count], joints);
+    fixedSink = joints.lift;
+    return reachable;
+  });
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,108 @@
+// Host test for a Motor's limit switch, on a RampBackend against a fake
+// TMC5160. Build and run from the repository root on a computer:
+//
+//   g++ -std=gnu++11 -DARDUINO=10819 -DF_CPU=16000000L -Itest/host -I. test/motor_test.cpp test/host/host.cpp limit.cpp interrupt.cpp ramp.cpp TMC_Stepper/*.cpp TMC_Stepper/TMC_HAL/TMC_HAL_Arduino.cpp -o motor_test && ./motor_test
+#include <stdio.h>
+#include "motor.h"
+#include "host.h"
+
+const uint8_t xactual = 0x21;
+const uint8_t xtarget = 0x2D;
+const int switchPin = 22;
+
+static bool failed = false;
+
+static void check(bool condition, const char* message) {
+  printf("%s: %s\n", condition ? "ok" : "FAIL", message);
+  if (!condition) failed = true;
+}
+
+// A lift with its switch at 10 units, below the motor, and a top at 90
+static void setUp(Tmc5160Motor& motor) {
+  motor.limitSwitch.pin = switchPin;
+  motor.limitSwitch.triggeredValue = LOW;
+  motor.limitSwitch.direction = -1;
+  motor.limitSwitch.position = 10;
+  motor.limitSwitch.minLimit = 10;
+  motor.limitSwitch.maxLimit = 90;
+  digitalWrite(switchPin, HIGH);
+}
+
+// Calibrating where the switch is pressed makes that the switch's position
+static void calibrate() {
+  FakeTmc5160& fake = addFakeDriver(10);
+  Tmc5160Motor motor({ "lift", spiDriver(10), 1000, 100, { 51200 }, { 100000 } });
+  setUp(motor);
+  check(motor.setup(), "the motor comes up");
+  motor.moveBySteps(-1234);
+  check(fake.registers[xtarget] == (uint32_t) -1234, "an uncalibrated move goes out");
+
+  digitalWrite(switchPin, LOW);
+  check(motor.calibrate(), "calibrate() finds the pressed switch");
+  check(motor.currentSteps() == 1000 && motor.currentPosition() == 10, "the motor is at the switch's position");
+
+  motor.moveTo(50);
+  check(fake.registers[xtarget] == (uint32_t) (-1234 + 4000), "a move is measured from the switch");
+}
+
+static void bounds() {
+  FakeTmc5160& fake = addFakeDriver(11);
+  Tmc5160Motor motor({ "lift", spiDriver(11), 1000, 100, { 51200 }, { 100000 } });
+  setUp(motor);
+  check(motor.setup(), "the motor comes up");
+  unsigned long targetWrites = fake.writes[xtarget];
+  motor.moveTo(95);
+  motor.moveTo(5);
+  check(fake.writes[xtarget] == targetWrites, "targets outside the bounds are ignored");
+  motor.moveTo(80);
+  check(fake.registers[xtarget] == 7000, "a target inside the bounds goes out");
+}
+
+// A move into a pressed switch stops, and a move away from it still goes out
+static void stopAtSwitch() {
+  FakeTmc5160& fake = addFakeDriver(12);
+  Tmc5160Motor motor({ "lift", spiDriver(12), 1000, 100, { 51200 }, { 100000 } });
+  setUp(motor);
+  check(motor.setup(), "the motor comes up");
+  motor.moveBySteps(-500);
+  fake.registers[xactual] = (uint32_t) -200;  // still on its way
+  motor.update();
+  check(fake.registers[xtarget] == (uint32_t) -500, "the move runs while the switch is open");
+
+  digitalWrite(switchPin, LOW);
+  motor.update();
+  check(fake.registers[xtarget] == (uint32_t) -200, "update() stops the move into the switch");
+
+  motor.moveBySteps(700);
+  fake.registers[xactual] = (uint32_t) -100;
+  motor.update();
+  check(fake.registers[xtarget] == 500, "a move away from the switch goes out");
+}
+
+// useInterrupt on a pin without an interrupt falls back to digitalRead(),
+// instead of a flag that only update() would refresh
+static void switchWithoutInterrupt() {
+  addFakeDriver(13);
+  Tmc5160Motor motor({ "lift", spiDriver(13), 1000, 100, { 51200 }, { 100000 } });
+  setUp(motor);
+  motor.limitSwitch.useInterrupt = true;
+  check(motor.setup(), "the motor comes up");
+  check(!motor.limitSwitch.isInterruptAttached, "pin 22 has no interrupt to attach");
+  digitalWrite(switchPin, LOW);
+  check(motor.isLimitPressed(), "the switch is read from the pin");
+  check(motor.calibrate() && motor.currentPosition() == 10, "calibrate() sees the press");
+
+  LimitSwitch interruptSwitch;
+  interruptSwitch.pin = 2;
+  interruptSwitch.useInterrupt = true;
+  check(interruptSwitch.attach(), "pin 2 has an interrupt to attach");
+  detachContextInterrupt(2);
+}
+
+int main() {
+  calibrate();
+  bounds();
+  stopAtSwitch();
+  switchWithoutInterrupt();
+  return failed ? 1 : 0;
+}
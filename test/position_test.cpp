@@ -0,0 +1,125 @@
+// Host test for position.h: both conversions against exact 128 bit integer
+// math, the round trip from steps to units and back, and conversions per
+// second next to the double math they replace. Build and run from the repository root on a computer:
+//
+//   g++ -std=gnu++11 -O2 -I. test/position_test.cpp -o position_test && ./position_test
+#include <chrono>
+#include <stdio.h>
+#include "position.h"
+
+using int128 = __int128;
+
+// value * numerator / denominator, rounded half away from zero
+static int128 scale(int128 value, int128 numerator, int128 denominator) {
+  bool negative = value < 0;
+  int128 magnitude = (negative ? -value : value) * numerator;
+  int128 result = (2 * magnitude + denominator) / (2 * denominator);
+  return negative ? -result : result;
+}
+
+static bool fits(int128 value) {
+  return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+struct Errors {
+  long long checked = 0;
+  long long toSteps = 0;
+  long long fromSteps = 0;
+  long long roundTrip = 0;
+};
+
+template<int32_t microsteps, int32_t units>
+static void checkSteps(Errors& errors, int32_t steps) {
+  using Position = FixedPosition<microsteps, units>;
+  errors.checked++;
+  int128 expected = scale(steps, (int128) units << 16, microsteps);
+  Position position;
+  bool converted = Position::fromSteps(steps, position);
+  if (converted != fits(expected) || (converted && position.value != expected)) errors.fromSteps++;
+  if (!converted) return;
+  int32_t back = 0;
+  if (!position.toSteps(back) || back != steps) errors.roundTrip++;
+}
+
+template<int32_t microsteps, int32_t units>
+static void checkUnits(Errors& errors, q16 value) {
+  int128 expected = scale(value, microsteps, (int128) units << 16);
+  int32_t steps = 0;
+  bool converted = FixedPosition<microsteps, units>(value).toSteps(steps);
+  if (converted != fits(expected) || (converted && steps != expected)) errors.toSteps++;
+}
+
+// Every step and position near zero, where joints spend their time, then a
+// stride across the whole range and its ends
+template<int32_t microsteps, int32_t units>
+static bool check() {
+  Errors errors;
+  for (int32_t value = -(1 << 21); value <= (1 << 21); value++) {
+    checkSteps<microsteps, units>(errors, value);
+    checkUnits<microsteps, units>(errors, value);
+  }
+  for (int64_t value = INT32_MIN; value <= INT32_MAX; value += 9973) {
+    checkSteps<microsteps, units>(errors, value);
+    checkUnits<microsteps, units>(errors, value);
+  }
+  for (int32_t offset = 0; offset < 1000; offset++) {
+    checkSteps<microsteps, units>(errors, INT32_MIN + offset);
+    checkSteps<microsteps, units>(errors, INT32_MAX - offset);
+    checkUnits<microsteps, units>(errors, INT32_MIN + offset);
+    checkUnits<microsteps, units>(errors, INT32_MAX - offset);
+  }
+  bool ok = errors.toSteps == 0 && errors.fromSteps == 0 && errors.roundTrip == 0;
+  printf("<%d, %d> %lld values: %lld toSteps, %lld fromSteps and %lld round trip errors: %s\n",
+    microsteps, units, errors.checked, errors.toSteps, errors.fromSteps, errors.roundTrip, ok ? "ok" : "FAIL");
+  return ok;
+}
+
+template<typename Loop>
+static double perSecond(int32_t conversions, Loop loop) {
+  auto start = std::chrono::steady_clock::now();
+  for (int32_t i = 0; i < conversions; i++) loop((int32_t) (i * 7919u));
+  return conversions / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Against the double math StepperMotor does with a runtime stepsPerUnit
+template<int32_t microsteps, int32_t units>
+static void benchmark() {
+  using Position = FixedPosition<microsteps, units>;
+  const int32_t conversions = 10000000;
+  volatile double configured = (double) microsteps / units;
+  const double stepsPerUnit = configured;
+  volatile int32_t sink = 0;
+  volatile double doubleSink = 0;
+
+  double fixedToSteps = perSecond(conversions, [&](int32_t value) {
+    int32_t steps = 0;
+    Position(value).toSteps(steps);
+    sink = steps;
+  });
+  double doubleToSteps = perSecond(conversions, [&](int32_t value) {
+    sink = value / 65536.0 * stepsPerUnit;
+  });
+  double fixedFromSteps = perSecond(conversions, [&](int32_t value) {
+    Position position;
+    Position::fromSteps(value, position);
+    sink = position.value;
+  });
+  double doubleFromSteps = perSecond(conversions, [&](int32_t value) {
+    doubleSink = value / stepsPerUnit;
+  });
+  printf("<%d, %d> on this computer, FixedPosition against double:\n", microsteps, units);
+  printf("  units to steps %12.0f/s %12.0f/s\n", fixedToSteps, doubleToSteps);
+  printf("  steps to units %12.0f/s %12.0f/s\n", fixedFromSteps, doubleFromSteps);
+}
+
+int main() {
+  bool ok = check<51200, 1>();
+  ok = check<51200 * 50, 360>() && ok;
+  ok = check<51200, 360>() && ok;
+  ok = check<200 * 16, 7>() && ok;
+  ok = check<65535, 1>() && ok;
+  ok = check<1, 1>() && ok;
+  ok = check<2000000000, 1999999999>() && ok;
+  benchmark<51200 * 50, 360>();
+  return ok ? 0 : 1;
+}
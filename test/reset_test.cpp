@@ -0,0 +1,44 @@
+// Host test for StepperMotor::recover_from_reset() against a fake TMC5160.
+// Build and run from the repository root on a computer:
+//
+//   g++ -std=gnu++11 -DARDUINO=10819 -DF_CPU=16000000L -Itest/host -I. test/reset_test.cpp test/host/host.cpp BURT_TMC.cpp limit.cpp interrupt.cpp ramp.cpp TMC_Stepper/*.cpp TMC_Stepper/TMC_HAL/TMC_HAL_Arduino.cpp -o reset_test && ./reset_test
+#include <stdio.h>
+#include "BURT_TMC.h"
+#include "host.h"
+
+const uint8_t xactual = 0x21;
+const uint8_t xtarget = 0x2D;
+
+static bool failed = false;
+
+static void check(bool condition, const char* message) {
+  printf("%s: %s\n", condition ? "ok" : "FAIL", message);
+  if (!condition) failed = true;
+}
+
+// A reset mid-jog ends the jog where the motor was, so the cached target has
+// to move there too rather than keep the last positioning move's
+static void resetWhileJogging() {
+  FakeTmc5160& fake = addFakeDriver(10);
+  StepperMotor motor({ 2, 10 }, { "lift", 1000, 1000, 100, 10.0 });
+  check(motor.setup(), "the motor comes up");
+  motor.moveToSteps(1000);
+  motor.refresh();
+  motor.jog(1.0);
+  fake.registers[xactual] = 1500;
+  motor.refresh();
+  check(motor.isJogging(), "the motor is jogging");
+
+  fake.powerOn();
+  motor.refresh();
+  check(motor.resetCount() == 1, "the reset is seen");
+  check(!motor.isJogging(), "the jog is over");
+  check(fake.registers[xactual] == 1500, "XACTUAL is restored");
+  check(fake.registers[xtarget] == 1500, "XTARGET holds the motor where it was");
+  check(motor.motionState().xtarget == 1500, "the cached target matches XTARGET");
+}
+
+int main() {
+  resetWhileJogging();
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,191 @@
+// Host test for the current scale lookups in TMCStepper.h, TMCStepper.hpp
+// and TMC2660Stepper.cpp. It runs the drivers' rms_current() and cs2rms()
+// for every Rsense from 1 to 255 and every current from 1 to 3000 mA, and
+// compares them with the float formulas the tables replaced. Build and run
+// from the repository root on a computer:
+//
+//   g++ -std=gnu++11 -O2 -DARDUINO=10819 -DF_CPU=16000000L -Itest/host -I. test/rms_test.cpp test/host/host.cpp TMC_Stepper/*.cpp TMC_Stepper/TMC_HAL/TMC_HAL_Arduino.cpp -o rms_test && ./rms_test
+//
+// The old formulas converted a float straight to uint8_t, which is
+// undefined once the value leaves 0..255, so those currents are skipped.
+// Where the old code was wrong on purpose, the test checks the new result:
+// the TMC2160 loop fell through to full scale for very low currents, and
+// the TMC2660's cs2rms() added 0.02 ohm that rms_current() didn't.
+#include <stdio.h>
+#include "TMCStepper.h"
+#include "host.h"
+
+const uint8_t csPin2130 = 10;
+const uint8_t csPin5160 = 11;
+const uint8_t csPin2660 = 12;
+const uint16_t maxCurrent = 3000;  // mA
+
+struct Scale {
+  bool defined;
+  uint8_t cs;
+  bool vsense;
+};
+
+// The old CS = 32*sqrt(2)*I*R/V_fs - 1, as uint8_t
+static bool to_cs(double value, uint8_t& cs) {
+  if (value <= -1 || value >= 256) return false;
+  cs = value;
+  return true;
+}
+
+// The old TMC2130 and TMC2660 rms_current(), falling back to vsense below
+// CS 16
+static Scale old_scale(double rs, uint16_t mA, double vfs, double vfsSense) {
+  Scale scale = { true, 0, false };
+  scale.defined = to_cs(32.0*1.41421*mA/1000.0*rs/vfs - 1, scale.cs);
+  if (scale.defined && scale.cs < 16) {
+    scale.vsense = true;
+    scale.defined = to_cs(32.0*1.41421*mA/1000.0*rs/vfsSense - 1, scale.cs);
+  }
+  if (scale.cs > 31) scale.cs = 31;
+  return scale;
+}
+
+// The old TMC2160 and TMC5160 rms_current(), trying each CS in turn. It
+// took a GLOBALSCALER that rounded down to 0 as full scale, and wrapped
+// around below CS 0, so for very low currents this does what the new code
+// does instead: it goes on down to CS 0 and keeps GLOBALSCALER at 32 or more.
+static void old_2160(uint8_t Rsense, uint16_t mA, uint8_t& cs, uint32_t& scaler) {
+  const float rs = Rsense/255.0;
+  const uint16_t RS_scaled = rs * 0xFFFF;
+  uint32_t numerator = 11585;
+  numerator *= RS_scaled;
+  numerator >>= 8;
+  numerator *= mA;
+  for (cs = 31; ; cs--) {
+    uint32_t denominator = 325 * 0xFFFF >> 8;
+    denominator *= cs+1;
+    scaler = numerator / denominator;
+    if (scaler > 255) {
+      scaler = 0;
+      return;
+    }
+    if (scaler >= 128 || cs == 0) break;
+  }
+  if (scaler < 32) scaler = 32;
+}
+
+static uint16_t old_2160_cs2rms(uint8_t Rsense, uint16_t scaler, uint8_t cs) {
+  const float rs = Rsense/255.0;
+  if (!scaler) scaler = 256;
+  uint32_t numerator = scaler * (cs+1);
+  numerator *= 325;
+  numerator >>= (8+5);
+  numerator *= 1000000;
+  uint32_t denominator = rs*1000;
+  denominator *= 1414;
+  return numerator / denominator;
+}
+
+static bool report(const char* name, long checked, long differences) {
+  printf("%-8s %ld checked, %ld different: %s\n", name, checked, differences, differences == 0 ? "ok" : "FAIL");
+  return differences == 0;
+}
+
+// Rsense is stored as uint8_t(RS * 255), so aim halfway between two steps
+static float ohms(int Rsense) {
+  return (Rsense + 0.5) / 255.0;
+}
+
+static bool check2130() {
+  long checked = 0, differences = 0;
+  for (int Rsense = 1; Rsense < 256; Rsense++) {
+    TMC2130Stepper driver(SPI, csPin2130, ohms(Rsense));
+    const float rs = Rsense/255.0+0.02;
+    for (uint16_t mA = 1; mA <= maxCurrent; mA++) {
+      Scale expected = old_scale(rs, mA, 0.325, 0.180);
+      if (!expected.defined) continue;
+      driver.rms_current(mA);
+      checked++;
+      if (driver.irun() != expected.cs || driver.vsense() != expected.vsense || driver.ihold() != (uint8_t) (expected.cs*0.5)) differences++;
+    }
+    for (int vsense = 0; vsense < 2; vsense++) {
+      driver.vsense(vsense);
+      for (uint8_t cs = 0; cs < 32; cs++) {
+        uint16_t expected = (float)(cs+1)/32.0 * (vsense ? 0.180 : 0.325)/rs / 1.41421 * 1000;
+        checked++;
+        if (driver.cs2rms(cs) != expected) differences++;
+      }
+    }
+  }
+  return report("TMC2130", checked, differences);
+}
+
+static bool check2300() {
+  long checked = 0, differences = 0;
+  for (int Rsense = 1; Rsense < 256; Rsense++) {
+    TMC2300Stepper driver(Serial, ohms(Rsense), 0);
+    const float rs = Rsense/255.0+0.03;
+    for (uint16_t mA = 1; mA <= maxCurrent; mA++) {
+      uint8_t expected;
+      if (!to_cs(32.0*1.41421*mA/1000.0*rs/0.325 - 1, expected)) continue;
+      if (expected > 31) expected = 31;
+      driver.rms_current(mA);
+      checked++;
+      if (driver.irun() != expected || driver.ihold() != (uint8_t) (expected*0.5)) differences++;
+    }
+    for (uint8_t cs = 0; cs < 32; cs++) {
+      uint16_t expected = (cs+1.0)/32.0 * 0.325/rs / 1.41421 * 1000;
+      checked++;
+      if (driver.cs2rms(cs) != expected) differences++;
+    }
+  }
+  return report("TMC2300", checked, differences);
+}
+
+static bool check5160() {
+  long checked = 0, differences = 0;
+  for (int Rsense = 1; Rsense < 256; Rsense++) {
+    TMC5160Stepper driver(SPI, csPin5160, ohms(Rsense));
+    for (uint16_t mA = 1; mA <= maxCurrent; mA++) {
+      uint8_t cs;
+      uint32_t scaler;
+      old_2160(Rsense, mA, cs, scaler);
+      driver.rms_current(mA);
+      checked += 2;
+      if (driver.irun() != cs || driver.GLOBAL_SCALER() != scaler) differences++;
+      if (driver.cs2rms(cs) != old_2160_cs2rms(Rsense, scaler, cs)) differences++;
+    }
+  }
+  return report("TMC5160", checked, differences);
+}
+
+// R_sense is a float for the TMC2660, so this steps through 0.03..1 ohm
+static bool check2660() {
+  long checked = 0, differences = 0;
+  for (int milliohms = 30; milliohms <= 1000; milliohms++) {
+    const float rs = milliohms / 1000.0;
+    TMC2660Stepper driver(SPI, csPin2660, rs);
+    for (uint16_t mA = 1; mA <= maxCurrent; mA++) {
+      Scale expected = old_scale(rs, mA, 0.310, 0.165);
+      if (!expected.defined) continue;
+      driver.rms_current(mA);
+      checked++;
+      if (driver.cs() != expected.cs || driver.vsense() != expected.vsense) differences++;
+    }
+    for (int vsense = 0; vsense < 2; vsense++) {
+      driver.vsense(vsense);
+      for (uint8_t cs = 0; cs < 32; cs++) {
+        uint16_t expected = (float)(cs+1)/32.0 * (vsense ? 0.165 : 0.310)/rs / 1.41421 * 1000;
+        checked++;
+        if (driver.cs2rms(cs) != expected) differences++;
+      }
+    }
+  }
+  return report("TMC2660", checked, differences);
+}
+
+int main() {
+  addFakeDriver(csPin2130);
+  addFakeDriver(csPin5160);
+  bool ok = check2130();
+  ok = check2300() && ok;
+  ok = check5160() && ok;
+  ok = check2660() && ok;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,176 @@
+// Host test for step_generator.cpp: records every step through onStep() and
+// checks the moves against the ideal trapezoid. Build and run from the
+// repository root on a computer:
+//
+//   g++ -std=gnu++11 -DARDUINO=10819 -DF_CPU=16000000L -Itest/host -I. test/step_generator_test.cpp test/host/host.cpp step_generator.cpp TMC_Stepper/*.cpp TMC_Stepper/TMC_HAL/TMC_HAL_Arduino.cpp -o step_generator_test && ./step_generator_test
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+#include "step_generator.h"
+
+const double frequency = 40000;  // Hz
+const double maxSpeed = 20000;  // µsteps/s
+const double acceleration = 200000;  // µsteps/s²
+const uint32_t maxTicks = 10000000;
+const double timingTolerance = 0.01;  // of the ideal time
+
+static bool failed = false;
+static std::vector<StepEvent> events;
+
+static void check(bool condition, const char* message) {
+  printf("%s: %s\n", condition ? "ok" : "FAIL", message);
+  if (!condition) failed = true;
+}
+
+static void record(const StepEvent& event) {
+  events.push_back(event);
+}
+
+static void runUntilStopped(StepGenerator& steppers) {
+  for (uint32_t tick = 0; tick < maxTicks; tick++) {
+    bool moving = false;
+    for (int axis = 0; axis < maxAxes; axis++) moving = moving || steppers.isMoving(axis);
+    if (!moving) return;
+    steppers.tick();
+  }
+}
+
+static std::vector<StepEvent> stepsOf(int axis) {
+  std::vector<StepEvent> steps;
+  for (const StepEvent& event : events) {
+    if (event.axis == axis) steps.push_back(event);
+  }
+  return steps;
+}
+
+// Seconds from the start to step `index` (from 1) of an ideal trapezoid
+static double idealTime(uint32_t index, uint32_t distance) {
+  double rampSteps = maxSpeed * maxSpeed / (2 * acceleration);
+  if (2 * rampSteps > distance) rampSteps = distance / 2.0;
+  double peak = sqrt(2 * acceleration * rampSteps);
+  double rampTime = peak / acceleration;
+  if (index <= rampSteps) return sqrt(2 * index / acceleration);
+  if (index <= distance - rampSteps) return rampTime + (index - rampSteps) / peak;
+  double left = distance - index;
+  return 2 * rampTime + (distance - 2 * rampSteps) / peak - sqrt(2 * left / acceleration);
+}
+
+static int addAxis(StepGenerator& steppers, int stepPin, int directionPin) {
+  int axis = steppers.addAxis({ stepPin, directionPin });
+  steppers.setLimits(axis, { maxSpeed }, { acceleration });
+  return axis;
+}
+
+static void exactMove() {
+  events.clear();
+  StepGenerator steppers(frequency);
+  steppers.onStep(record);
+  int axis = addAxis(steppers, 2, 3);
+  check(steppers.moveTo(axis, 10000), "the move starts");
+  runUntilStopped(steppers);
+
+  std::vector<StepEvent> steps = stepsOf(axis);
+  bool forward = true;
+  for (const StepEvent& step : steps) forward = forward && step.direction == 1;
+  check(steps.size() == 10000 && forward, "10000 steps, all forward");
+  check(steppers.position(axis) == 10000, "the axis ends at its target");
+
+  // Seconds, against the ideal trapezoid at the same limits
+  double worst = 0;
+  for (uint32_t index = 1; index <= steps.size(); index++) {
+    double ideal = idealTime(index, 10000);
+    double error = fabs(steps[index - 1].tick / frequency - ideal) / ideal;
+    if (index >= 10 && error > worst) worst = error;  // the first steps are a tick or two apart
+  }
+  double total = steps.back().tick / frequency;
+  printf("move took %.4f s, ideal %.4f s, worst step %.2f%% off\n", total, idealTime(10000, 10000), worst * 100);
+  check(worst < timingTolerance, "every step is within 1% of the ideal trapezoid");
+}
+
+static void twoAxes() {
+  events.clear();
+  StepGenerator steppers(frequency);
+  steppers.onStep(record);
+  int first = addAxis(steppers, 2, 3);
+  int second = addAxis(steppers, 4, 5);
+  steppers.moveTo(first, 3000);
+  steppers.moveTo(second, -5000);
+  runUntilStopped(steppers);
+
+  std::vector<StepEvent> a = stepsOf(first), b = stepsOf(second);
+  check(a.size() == 3000 && b.size() == 5000, "both axes take every step");
+  check(steppers.position(first) == 3000 && steppers.position(second) == -5000, "both axes end at their targets");
+  check(b.front().direction == -1 && a.back().tick > b.front().tick && b.back().tick > a.front().tick, "the axes run at the same time");
+  double secondTime = b.back().tick / frequency;
+  check(fabs(secondTime - idealTime(5000, 5000)) / idealTime(5000, 5000) < timingTolerance, "the other axis doesn't slow one down");
+}
+
+static void stopSlowsDown() {
+  events.clear();
+  StepGenerator steppers(frequency);
+  steppers.onStep(record);
+  int axis = addAxis(steppers, 2, 3);
+  steppers.moveTo(axis, 100000);
+  while (steppers.position(axis) < 5000) steppers.tick();
+  steppers.stop(axis);
+  size_t stoppedAt = events.size();
+  runUntilStopped(steppers);
+
+  size_t stoppingSteps = events.size() - stoppedAt;
+  double ideal = maxSpeed * maxSpeed / (2 * acceleration);
+  printf("stopped in %zu steps, ideal %.0f\n", stoppingSteps, ideal);
+  check(fabs(stoppingSteps - ideal) / ideal < timingTolerance, "stop() takes the ramp's distance to stop");
+
+  bool slowing = true;
+  for (size_t index = stoppedAt + 2; index < events.size(); index++) {
+    uint32_t interval = events[index].tick - events[index - 1].tick;
+    uint32_t previous = events[index - 1].tick - events[index - 2].tick;
+    if (interval + 1 < previous) slowing = false;  // a tick of jitter from the phase
+  }
+  check(slowing, "the steps spread out until the axis stops");
+}
+
+static void reversedTarget() {
+  events.clear();
+  StepGenerator steppers(frequency);
+  steppers.onStep(record);
+  int axis = addAxis(steppers, 2, 3);
+  steppers.moveTo(axis, 2000);
+  for (int tick = 0; tick < 1000; tick++) steppers.tick();
+  int32_t position = steppers.position(axis);
+  check(!steppers.moveTo(axis, -2000), "a target behind a moving axis is refused");
+  check(steppers.isMoving(axis), "the axis keeps going");
+  runUntilStopped(steppers);
+  check(steppers.position(axis) == 2000 && position < 2000, "and finishes the first move");
+  check(steppers.moveTo(axis, -2000), "once stopped, it takes the target");
+  runUntilStopped(steppers);
+  check(steppers.position(axis) == -2000 && events.back().direction == -1, "and steps back to it");
+}
+
+// Without a callback, the steps toggle the STEP pin and DIR follows the move
+static void pinWrites() {
+  StepGenerator steppers(frequency);
+  int axis = addAxis(steppers, 6, 7);
+  check(digitalRead(6) == LOW, "STEP starts low");
+  steppers.moveTo(axis, -3);
+  check(digitalRead(7) == LOW, "DIR is low for a move back");
+  int edges = 0;
+  int level = digitalRead(6);
+  while (steppers.isMoving(axis)) {
+    steppers.tick();
+    if (digitalRead(6) != level) edges++;
+    level = digitalRead(6);
+  }
+  check(edges == 3, "each step is one edge on STEP");
+  steppers.moveTo(axis, 0);
+  check(digitalRead(7) == HIGH, "DIR is high for a move forward");
+}
+
+int main() {
+  exactMove();
+  twoAxes();
+  stopSlowsDown();
+  reversedTarget();
+  pinWrites();
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,56 @@
+// Host test for VelocityController's StallGuard homing against a fake
+// TMC2209 on the UART. Build and run from the repository root on a computer:
+//
+//   g++ -std=gnu++11 -DARDUINO=10819 -DF_CPU=16000000L -Itest/host -I. test/velocity_test.cpp test/host/host.cpp TMC_Stepper/*.cpp TMC_Stepper/TMC_HAL/TMC_HAL_Arduino.cpp -o velocity_test && ./velocity_test
+#include <stdio.h>
+#include "TMCStepper.h"
+#include "velocity_controller.h"
+#include "host.h"
+
+const uint8_t sgResult = 0x41;
+const uint8_t threshold = 50;
+const unsigned long updateInterval = 10000;  // µs
+
+static bool failed = false;
+
+static void check(bool condition, const char* message) {
+  printf("%s: %s\n", condition ? "ok" : "FAIL", message);
+  if (!condition) failed = true;
+}
+
+static void runUpdates(VelocityController<TMC2209Stepper>& controller, int count) {
+  for (int update = 0; update < count; update++) {
+    advanceMicros(updateInterval);
+    controller.update();
+  }
+}
+
+// A reply with a bad CRC reads as 0, which must not count as a stall, and
+// is tried only once
+static void badReplyDuringHoming() {
+  FakeTmc2209& fake = fakeUartDriver();
+  fake.registers[sgResult] = 500;
+  TMC2209Stepper driver(Serial, 0.11, 0);
+  VelocityController<TMC2209Stepper> controller(driver);
+  controller.setLimits({ 2000 }, { 100000 });
+  controller.startHoming({ 2000 }, threshold);
+  runUpdates(controller, 50);
+  check(controller.isHoming() && fake.reads[sgResult] > 0, "homing runs at speed and reads SG_RESULT");
+
+  fake.registers[sgResult] = 0;
+  fake.corruptReplies = 5;
+  unsigned long reads = fake.reads[sgResult];
+  runUpdates(controller, 2);
+  check(controller.isHoming() && !controller.isHomed(), "a reply with a bad CRC isn't a stall");
+  check(fake.reads[sgResult] - reads == 2, "each check sends the read once");
+  check(driver.readAttempts() == 5, "other reads still retry");
+
+  fake.corruptReplies = 0;
+  runUpdates(controller, 2);
+  check(controller.isHomed() && !controller.isMoving(), "a real stall still stops the motor");
+}
+
+int main() {
+  badReplyDuringHoming();
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,91 @@
+#include "trajectory.h"
+
+Trajectory::Trajectory(StepperMotor& motor) :
+  motor(motor)
+  { }
+
+bool Trajectory::add(double position, unsigned long time) {
+  if (!motor.limitSwitch.isValid(position)) return false;
+  int32_t steps = position * motor.config.stepsPerUnit;
+  return addSteps(steps, time);
+}
+
+bool Trajectory::addSteps(int32_t steps, unsigned long time) {
+  return waypoints.push({steps, time});
+}
+
+// Drops the queued waypoints. The motor still finishes its current segment.
+void Trajectory::clear() {
+  waypoints.clear();
+}
+
+bool Trajectory::isDone() {
+  return !active && waypoints.isEmpty();
+}
+
+int Trajectory::size() {
+  return waypoints.size();
+}
+
+// Call from loop()
+void Trajectory::update() {
+  Waypoint next;
+  if (!active) {
+    if (!waypoints.pop(next)) return;
+    int32_t steps = motor.motionState(true).xactual + motor.limitSwitch.offset + motor.homeSteps;
+    Waypoint from = {steps, millis()};
+    start_segment(from, next);
+    return;
+  }
+
+  motor.refresh();
+  if (waypoints.isEmpty()) {
+    TMC5160Stepper::RAMP_STAT_t status { motor.motionState().rampStat };
+    if (status.position_reached) active = false;
+    return;
+  }
+
+  if (!is_braking()) return;
+  waypoints.pop(next);
+  start_segment(current, next);
+}
+
+void Trajectory::start_segment(const Waypoint& from, const Waypoint& to) {
+  RampParameters ramp = motor.defaultRamp();
+  long distance = to.steps - from.steps;
+  long duration = to.time - from.time;
+  if (distance < 0) distance = -distance;
+
+  // Arrive on time, but never faster than the joint's own limit.
+  // A late waypoint is chased at full speed.
+  if (distance > 0 && duration > 0) {
+    uint32_t vmax = motor.clock.velocity({distance * 1000.0 / duration});
+    if (vmax < 1) vmax = 1;
+    if (vmax < ramp.vmax) ramp.vmax = vmax;
+  }
+
+  // VMAX goes out before XTARGET so the new segment starts at its own speed
+  motor.setRamp(ramp);
+  motor.write_target(motor.to_driver_steps(to.steps));
+  current = to;
+  active = true;
+}
+
+// Whether the driver is about to start slowing down for the current
+// waypoint, within one lookahead window.
+bool Trajectory::is_braking() {
+  const MotionState& state = motor.motionState();
+  int64_t remaining = (int64_t) state.xtarget - state.xactual;
+  int64_t velocity = state.vactual;
+  if (remaining < 0) remaining = -remaining;
+  if (velocity < 0) velocity = -velocity;
+
+  // In chip units the braking distance doesn't depend on the clock. With
+  // no deceleration the driver can't slow down in time, so send the next
+  // waypoint right away.
+  uint16_t dmax = motor.ramp().dmax;
+  if (dmax == 0) return true;
+  int64_t braking = velocity * velocity / (256ll * dmax);
+  int64_t lookahead = motor.clock.toVelocity(velocity).microstepsPerSecond * trajectoryLookahead / 1000;
+  return remaining <= braking + lookahead;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "BURT_TMC.h"
+#include "ring_buffer.h"
+
+const int trajectoryCapacity = 16;
+const unsigned long trajectoryLookahead = 20;  // ms
+
+struct Waypoint {
+  int32_t steps;  // int is only 16 bits on AVR
+  unsigned long time;  // millis() at which to pass through this point
+};
+
+// Streams waypoints to one motor. The next waypoint is sent before the
+// driver starts slowing down for the current one, so the motor passes
+// through each point instead of stopping at it.
+class Trajectory {
+  private:
+    StepperMotor& motor;
+    RingBuffer<Waypoint, trajectoryCapacity> waypoints;
+    Waypoint current;
+    bool active = false;
+
+    void start_segment(const Waypoint& from, const Waypoint& to);
+    bool is_braking();
+
+  public:
+    Trajectory(StepperMotor& motor);
+
+    bool add(double position, unsigned long time);
+    bool addSteps(int32_t steps, unsigned long time);
+    void clear();
+    bool isDone();
+    int size();
+
+    void update();
+};
@@ -0,0 +1,78 @@
+#pragma once
+#include <stdint.h>
+
+constexpr double pi = 3.141592653589793;
+constexpr int microstepsPerStep = 256;
+constexpr int stepsPerRotation = 200;
+constexpr int degreesPerRotation = 360;
+constexpr double radiansPerRotation = 2 * pi;
+
+// In double, since 51200 doesn't fit in AVR's 16-bit int
+constexpr double microstepsPerRotation = (double) microstepsPerStep * stepsPerRotation;
+constexpr double microstepsPerRadian = microstepsPerRotation / radiansPerRotation;
+// 142.22. Before units.h this was all int math: 142 on 32-bit boards, and
+// -39 on AVR, where the product overflowed, as did microstepsPerRadian.
+constexpr double microstepsPerDegree = microstepsPerRotation / degreesPerRotation;
+
+constexpr double driverClock = 12000000;  // Hz, the TMC5160's internal clock
+
+// Rates at the motor shaft. Wrapping them keeps a value in rad/s from being
+// written to a register that wants chip units, or the other way around.
+struct Velocity {
+  double microstepsPerSecond;
+};
+
+struct Acceleration {
+  double microstepsPerSecondSquared;
+};
+
+constexpr Velocity radiansPerSecond(double value) { return Velocity { value * microstepsPerRadian }; }
+constexpr Velocity degreesPerSecond(double value) { return Velocity { value * microstepsPerDegree }; }
+constexpr Acceleration radiansPerSecondSquared(double value) { return Acceleration { value * microstepsPerRadian }; }
+constexpr Acceleration degreesPerSecondSquared(double value) { return Acceleration { value * microstepsPerDegree }; }
+
+// Converts between physical rates and the ramp registers for one clock:
+//   v[µsteps/s]  = VMAX * fCLK / 2^24
+//   a[µsteps/s²] = AMAX * fCLK² / 2^41
+// The scale factors are worked out once, so a conversion is one multiply,
+// and a constexpr clock converts compile time configs at compile time.
+class ChipClock {
+  private:
+    double velocityScale;      // register units per µstep/s
+    double accelerationScale;  // register units per µstep/s²
+    double velocityUnit;       // µsteps/s per register unit
+    double accelerationUnit;   // µsteps/s² per register unit
+
+  public:
+    constexpr ChipClock(double frequency) :
+      velocityScale(16777216.0 / frequency),
+      accelerationScale(2199023255552.0 / (frequency * frequency)),
+      velocityUnit(frequency / 16777216.0),
+      accelerationUnit(frequency * frequency / 2199023255552.0)
+      { }
+
+    // VMAX, V1, VSTART and VSTOP, rounded. The caller clamps to the register width.
+    constexpr uint32_t velocity(Velocity value) const {
+      return value.microstepsPerSecond <= 0 ? 0
+        : value.microstepsPerSecond * velocityScale >= 4294967295.0 ? 0xFFFFFFFF
+        : (uint32_t) (value.microstepsPerSecond * velocityScale + 0.5);
+    }
+
+    // AMAX, DMAX, A1 and D1, rounded and kept within 1..65535
+    constexpr uint16_t acceleration(Acceleration value) const {
+      return value.microstepsPerSecondSquared * accelerationScale + 0.5 < 1 ? 1
+        : value.microstepsPerSecondSquared * accelerationScale + 0.5 >= 65535 ? 65535
+        : (uint16_t) (value.microstepsPerSecondSquared * accelerationScale + 0.5);
+    }
+
+    // Also takes VACTUAL, which is signed
+    constexpr Velocity toVelocity(int32_t value) const {
+      return Velocity { value * velocityUnit };
+    }
+
+    constexpr Acceleration toAcceleration(uint16_t value) const {
+      return Acceleration { value * accelerationUnit };
+    }
+};
+
+constexpr ChipClock internalClock(driverClock);
@@ -0,0 +1,237 @@
+#pragma once
+#include <Arduino.h>
+#include "units.h"
+
+// Ramps VACTUAL from the host for UART drivers such as the TMC2208 and
+// TMC2209, whose internal step generator runs at a constant speed with no
+// ramp of its own. Call update() from loop(): it changes VACTUAL by at most
+// the acceleration limit every update interval, and only writes when the
+// UART can take a write without waiting, so it never blocks.
+//
+// There's no step counter to read back, so the position is estimated by
+// integrating the velocity that was written, and drifts if the motor
+// stalls or skips. Home against a hard stop with StallGuard to zero it.
+template<class Driver>
+class VelocityController {
+  private:
+    enum class Mode { idle, velocity, position, homing };
+
+    static const int32_t maxVactual = (1l << 23) - 1;  // VACTUAL is 24 bit signed
+    static const uint32_t updateInterval = 10000;  // µs, 100 Hz
+    static const uint32_t maxIntegrationStep = 65535;  // µs, keeps the product within 64 bits
+    static const uint8_t stallReadAttempts = 1;
+
+    Driver& driver;
+    ChipClock clock;
+    int64_t integrationFactor;  // Q32 microsteps per VACTUAL per µs, fCLK * 2^8 / 10^6
+
+    int32_t maxVelocity = maxVactual;
+    uint32_t acceleration = 0;  // VACTUAL per second
+    double accelerationMicrosteps = 0;
+
+    Mode mode = Mode::idle;
+    int32_t vactual = 0;  // as last written
+    int32_t commanded = 0;  // VACTUAL in velocity and homing modes
+    int32_t target = 0;
+    int8_t direction = 1;
+    uint8_t stallThreshold = 0;
+    bool stallPending = false;
+    bool homed = false;
+
+    int64_t positionQ32 = 0;  // microsteps
+    unsigned long lastIntegration = 0;
+    unsigned long lastUpdate = 0;
+
+    int32_t to_vactual(Velocity velocity) const {
+      bool negative = velocity.microstepsPerSecond < 0;
+      uint32_t magnitude = clock.velocity({negative ? -velocity.microstepsPerSecond : velocity.microstepsPerSecond});
+      int32_t value = magnitude > (uint32_t) maxVelocity ? maxVelocity : magnitude;
+      return negative ? -value : value;
+    }
+
+    // v[µsteps/s] = VACTUAL * fCLK / 2^24, so each µs at VACTUAL moves
+    // VACTUAL * integrationFactor in Q32
+    void integrate(unsigned long now) {
+      unsigned long elapsed = now - lastIntegration;
+      lastIntegration = now;
+      while (elapsed > 0) {
+        uint32_t step = maxIntegrationStep;
+        if (elapsed < step) step = elapsed;
+        positionQ32 += (int64_t) vactual * step * integrationFactor;
+        elapsed -= step;
+      }
+    }
+
+    // Restarts the update clock, so a move from standstill starts with one
+    // interval of acceleration instead of however long the motor sat idle
+    void start(Mode next) {
+      if (mode == Mode::idle && vactual == 0) lastUpdate = micros() - updateInterval;
+      mode = next;
+      stallPending = false;
+    }
+
+    // Distance to stop from `speed`, plus what one more update at that speed
+    // covers before the next chance to slow down
+    double stopping_distance(double speed) const {
+      return speed * speed / (2 * accelerationMicrosteps) + speed * updateInterval / 1e6;
+    }
+
+    // Speeds up only while it could still stop from the next speed, holds
+    // while it could stop from this one, and slows down otherwise, so it
+    // never flips between the two near the point where it starts to slow
+    // down. A move that comes up short creeps the rest of the way, aiming to
+    // cover it in one update; one that overshoots stops where it passes.
+    int32_t position_velocity() {
+      int32_t remaining = target - position();
+      if (remaining == 0 || (remaining > 0) != (direction > 0)) {
+        mode = Mode::idle;
+        return 0;
+      }
+      double distance = remaining < 0 ? -remaining : remaining;
+      double speed = clock.toVelocity(vactual < 0 ? -vactual : vactual).microstepsPerSecond;
+      if (distance > stopping_distance(speed + accelerationMicrosteps * updateInterval / 1e6)) return direction * maxVelocity;
+      if (vactual == 0) return direction * to_vactual({distance * 1e6 / updateInterval});
+      if (distance > stopping_distance(speed)) return vactual;
+      return 0;
+    }
+
+    int32_t target_velocity() {
+      switch (mode) {
+        case Mode::velocity: return commanded;
+        case Mode::homing: return stallPending ? 0 : commanded;
+        case Mode::position: return position_velocity();
+        default: return 0;
+      }
+    }
+
+    int32_t approach(int32_t velocity, uint32_t elapsed) const {
+      int32_t change = (int64_t) acceleration * elapsed / 1000000;
+      if (change < 1) change = 1;
+      if (velocity > vactual) return velocity - vactual > change ? vactual + change : velocity;
+      return vactual - velocity > change ? vactual - change : velocity;
+    }
+
+    // Drivers without StallGuard never report a stall, so update() still
+    // builds for them
+    template<class T>
+    static auto stallguard_result(T& driver, int) -> decltype(driver.SG_RESULT()) { return driver.SG_RESULT(); }
+    template<class T>
+    static uint16_t stallguard_result(T&, long) { return 0xFFFF; }
+
+    // StallGuard reads are only meaningful at a steady speed. A read that
+    // timed out or failed its CRC returns 0, so it's ignored rather than
+    // taken as a stall. It's tried once, since the next update reads again
+    // anyway, so a bad reply blocks for one abort window instead of five.
+    void check_stall() {
+      uint8_t attempts = driver.readAttempts();
+      driver.readAttempts(stallReadAttempts);
+      uint16_t result = stallguard_result(driver, 0);
+      bool failed = driver.readFailed();
+      driver.readAttempts(attempts);
+      if (!failed && result < 2 * stallThreshold) stallPending = true;
+    }
+
+    void write_velocity(int32_t velocity) {
+      driver.VACTUAL((uint32_t) velocity);
+      vactual = velocity;
+    }
+
+  public:
+    VelocityController(Driver& driver, double clockFrequency = driverClock) :
+      driver(driver),
+      clock(clockFrequency),
+      integrationFactor(clockFrequency * 256 / 1e6 + 0.5)
+      { }
+
+    // Velocities are in the driver's microsteps. Call before moving.
+    void setLimits(Velocity maxVelocity, Acceleration acceleration) {
+      this->maxVelocity = maxVactual;  // so the old limit doesn't clamp the new one
+      this->maxVelocity = to_vactual(maxVelocity);
+      if (this->maxVelocity < 1) this->maxVelocity = 1;
+      this->acceleration = clock.velocity({acceleration.microstepsPerSecondSquared});
+      if (this->acceleration < 1) this->acceleration = 1;
+      accelerationMicrosteps = clock.toVelocity(this->acceleration).microstepsPerSecond;
+    }
+
+    // Runs until told otherwise. Negative velocities turn the other way.
+    void setVelocity(Velocity velocity) {
+      commanded = to_vactual(velocity);
+      start(Mode::velocity);
+    }
+
+    void moveTo(int32_t position) {
+      target = position;
+      direction = position >= this->position() ? 1 : -1;
+      start(Mode::position);
+    }
+
+    void moveBy(int32_t steps) {
+      moveTo(position() + steps);
+    }
+
+    // Slows down with the acceleration limit
+    void stop() {
+      mode = Mode::idle;
+      stallPending = false;
+    }
+
+    // Runs at `velocity` until StallGuard sees the motor stall, then stops
+    // at once and zeroes the position. Sets up the StallGuard registers with
+    // blocking writes, so call it while the motor is still. TMC2209 only, and
+    // StallGuard only works in StealthChop.
+    void startHoming(Velocity velocity, uint8_t threshold) {
+      driver.TCOOLTHRS(0xFFFFF);
+      driver.SGTHRS(threshold);
+      stallThreshold = threshold;
+      commanded = to_vactual(velocity);
+      homed = false;
+      start(Mode::homing);
+    }
+
+    bool isMoving() const { return mode != Mode::idle || vactual != 0; }
+    bool isHoming() const { return mode == Mode::homing; }
+    bool isHomed() const { return homed; }
+
+    int32_t position() {
+      integrate(micros());
+      return positionQ32 >> 32;
+    }
+
+    void setPosition(int32_t position) {
+      integrate(micros());
+      positionQ32 = (int64_t) position << 32;
+    }
+
+    Velocity velocity() const { return clock.toVelocity(vactual); }
+
+    // Call often. Returns true if it talked to the driver. A stall check
+    // during homing is a UART read, which takes the update's turn on the
+    // bus, and the stop goes out on the next update.
+    bool update() {
+      unsigned long now = micros();
+      integrate(now);
+      if (mode == Mode::idle && vactual == 0) return false;
+      if (now - lastUpdate < updateInterval) return false;
+      if (!driver.writeReady()) return false;
+      unsigned long elapsed = now - lastUpdate;
+      lastUpdate = now;
+
+      if (stallPending) {
+        write_velocity(0);
+        positionQ32 = 0;
+        mode = Mode::idle;
+        stallPending = false;
+        homed = true;
+        return true;
+      }
+      if (mode == Mode::homing && vactual == commanded) {
+        check_stall();
+        return true;
+      }
+
+      int32_t next = approach(target_velocity(), elapsed > 2 * updateInterval ? 2 * updateInterval : elapsed);
+      if (next == vactual) return false;
+      write_velocity(next);
+      return true;
+    }
+};